@@ -0,0 +1,79 @@
+#ifndef __INTERVAL_TREE_HPP__
+#define __INTERVAL_TREE_HPP__
+
+#include <monoid.hpp>
+#include <tree.hpp>
+
+#include <vector>
+
+// Closed interval [low, high], ordered by its start.
+template<class T>
+struct Interval {
+    Interval(const T& _low = T(), const T& _high = T()) :
+        low(_low), high(_high)
+    { }
+
+    bool operator==(const Interval& that) const {
+        return low == that.low && high == that.high;
+    }
+
+    bool operator<=(const Interval& that) const {
+        return low <= that.low;
+    }
+
+    T low;
+    T high;
+};
+
+template<class T>
+struct IntervalHigh {
+    const T& operator()(const Interval<T>& interval) const {
+        return interval.high;
+    }
+};
+
+// Tree of intervals keyed by start, every node caches the greatest end
+// point of its subtree, so subtrees ending before a query are skipped.
+template<class T>
+class IntervalTree : public Tree<Interval<T>, MaxMonoid<Interval<T>, IntervalHigh<T>>> {
+public:
+    using Base = Tree<Interval<T>, MaxMonoid<Interval<T>, IntervalHigh<T>>>;
+    using NodeType = typename Base::NodeType;
+
+    // Stored intervals intersecting [lo, hi], ordered by start.
+    std::vector<const Interval<T>*> overlapping(const T& lo, const T& hi) {
+        std::vector<const Interval<T>*> found;
+        std::vector<NodeType*> stack;
+        auto node = this->peekRoot();
+        while (!stack.empty() || node != nullptr) {
+            if (node != nullptr) {
+                // everything below ends before lo
+                if (!(lo <= node->getSummary())) {
+                    node = nullptr;
+                    continue;
+                }
+                stack.push_back(node);
+                node = node->getLeft().get();
+            }
+            else {
+                node = stack.back();
+                stack.pop_back();
+                const auto& interval = node->getContent();
+                // this and every following interval start after hi
+                if (!(interval.low <= hi))
+                    break;
+                if (lo <= interval.high)
+                    found.push_back(&interval);
+                node = node->getRight().get();
+            }
+        }
+        return found;
+    }
+
+    // Stored intervals containing point, ordered by start.
+    std::vector<const Interval<T>*> stabbing(const T& point) {
+        return overlapping(point, point);
+    }
+};
+
+#endif // __INTERVAL_TREE_HPP__
@@ -0,0 +1,81 @@
+#ifndef __MONOID_HPP__
+#define __MONOID_HPP__
+
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// Stock monoids for Tree<Type, Monoid>. Each one aggregates a value
+// projected out of the element, the element itself by default.
+
+struct SelfProjection {
+    template<class T>
+    const T& operator()(const T& el) const {
+        return el;
+    }
+};
+
+template<class T, class Project>
+using ProjectedType = typename std::decay<
+    decltype(std::declval<Project>()(std::declval<const T&>()))>::type;
+
+template<class T, class Project = SelfProjection>
+struct SumMonoid {
+    using value_type = ProjectedType<T, Project>;
+
+    static value_type identity() {
+        return value_type();
+    }
+
+    static value_type lift(const T& el) {
+        return Project()(el);
+    }
+
+    static value_type combine(const value_type& a, const value_type& b) {
+        return a + b;
+    }
+};
+
+template<class T, class Project = SelfProjection>
+struct MinMonoid {
+    using value_type = ProjectedType<T, Project>;
+    // numeric_limits<>::max() silently yields value_type() otherwise
+    static_assert(std::numeric_limits<value_type>::is_specialized,
+        "MinMonoid needs numeric_limits of the projected type, "
+        "project to an arithmetic type or write a monoid with its own identity()");
+
+    static value_type identity() {
+        return std::numeric_limits<value_type>::max();
+    }
+
+    static value_type lift(const T& el) {
+        return Project()(el);
+    }
+
+    static value_type combine(const value_type& a, const value_type& b) {
+        return b < a ? b : a;
+    }
+};
+
+template<class T, class Project = SelfProjection>
+struct MaxMonoid {
+    using value_type = ProjectedType<T, Project>;
+    // numeric_limits<>::lowest() silently yields value_type() otherwise
+    static_assert(std::numeric_limits<value_type>::is_specialized,
+        "MaxMonoid needs numeric_limits of the projected type, "
+        "project to an arithmetic type or write a monoid with its own identity()");
+
+    static value_type identity() {
+        return std::numeric_limits<value_type>::lowest();
+    }
+
+    static value_type lift(const T& el) {
+        return Project()(el);
+    }
+
+    static value_type combine(const value_type& a, const value_type& b) {
+        return a < b ? b : a;
+    }
+};
+
+#endif // __MONOID_HPP__
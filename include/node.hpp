@@ -3,11 +3,46 @@
 
 #include <memory>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#endif
+
+// Hints the CPU to start pulling addr into cache without waiting for it.
+inline void prefetch(const void* addr) {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_prefetch(static_cast<const char*>(addr), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(addr);
+#endif
+}
+
 template<class T>
 using UPtr = std::unique_ptr<T>;
 
-template<class T>
-class Node {
+// Monoid of trees that keep no per-subtree aggregate.
+struct NoMonoid { };
+
+// Aggregate of a node's subtree, cached by trees built with a Monoid.
+template<class Monoid>
+class NodeSummary {
+public:
+    const typename Monoid::value_type& getSummary() const {
+        return summary;
+    }
+
+    void setSummary(typename Monoid::value_type s) {
+        summary = std::move(s);
+    }
+
+private:
+    typename Monoid::value_type summary = Monoid::identity();
+};
+
+template<>
+class NodeSummary<NoMonoid> { };
+
+template<class T, class Monoid = NoMonoid>
+class Node : public NodeSummary<Monoid> {
 public:
 	Node(T* ptr = nullptr) {
         data.reset(ptr);
@@ -20,14 +55,31 @@ public:
     Node(const Node& n) = delete;
     Node& operator=(const Node& other) = delete;
 
-    Node(Node&& n) = default;
-    Node& operator=(Node&& n) = default;
+    // Children are re-parented to the new object. The parent link stays
+    // with the object since it describes where that object is linked.
+    Node(Node&& n) :
+        NodeSummary<Monoid>(std::move(n)),
+        data(std::move(n.data)),
+        left(std::move(n.left)),
+        right(std::move(n.right))
+    {
+        adoptChildren();
+    }
+
+    Node& operator=(Node&& n) {
+        NodeSummary<Monoid>::operator=(std::move(n));
+        data = std::move(n.data);
+        left = std::move(n.left);
+        right = std::move(n.right);
+        adoptChildren();
+        return *this;
+    }
 
     virtual ~Node() { }
 
     template<class... Types>
     static auto makeNode(Types&&... args) {
-        return std::make_unique<Node<T>>(
+        return std::make_unique<Node>(
             new T(std::forward<Types>(args)...));
     }
 
@@ -43,15 +95,23 @@ public:
         return right != nullptr;
     }
     
-    bool isParent(const Node<T>* node) {
+    bool isParent(const Node* node) {
         return left.get() == node || right.get() == node;
     }
 
-	UPtr<Node<T>>& getLeft() {
+    Node* getParent() const {
+        return parent;
+    }
+
+    void setParent(Node* p) {
+        parent = p;
+    }
+
+	UPtr<Node>& getLeft() {
 		return left;
 	}
 
-	UPtr<Node<T>>& getRight() {
+	UPtr<Node>& getRight() {
 		return right;
 	}
 
@@ -61,26 +121,49 @@ public:
         return *data;
 	}
 
-    void setLeft(UPtr<Node<T>> p) {
+    // Unchecked access to the payload address, nullptr for empty nodes.
+    const T* getContentPtr() const noexcept {
+        return data.get();
+    }
+
+    void setLeft(UPtr<Node> p) {
         left = std::move(p);
+        if (left)
+            left->parent = this;
     }
 
-    void setRight(UPtr<Node<T>> p) {
+    void setRight(UPtr<Node> p) {
         right = std::move(p);
+        if (right)
+            right->parent = this;
     }
 
     void setContent(UPtr<T> p) {
         data = std::move(p);
     }
 
+    UPtr<T> releaseContent() {
+        return std::move(data);
+    }
+
     inline bool isLeaf() {
         return !hasLeft() && !hasRight();
     }
 
 private:
+    void adoptChildren() {
+        if (left)
+            left->parent = this;
+        if (right)
+            right->parent = this;
+    }
+
 	UPtr<T> data;
-	UPtr<Node<T>> left;
-	UPtr<Node<T>> right;
+	UPtr<Node> left;
+	UPtr<Node> right;
+    // owner of this node; kept by setLeft()/setRight(), not by
+    // assignments through the references getLeft()/getRight() return
+    Node* parent = nullptr;
 };
 
 #endif __NODE_HPP__
\ No newline at end of file
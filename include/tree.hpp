@@ -3,111 +3,973 @@
 
 #include <node.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <functional>
-#include <stack>
+#include <future>
+#include <iterator>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
-template<class T>
-using UPtrNode = std::unique_ptr<Node<T>>;
+template<class T, class Monoid = NoMonoid>
+using UPtrNode = std::unique_ptr<Node<T, Monoid>>;
 
-template<class Type>
+// Monoid, if given, is aggregated over every subtree; it provides
+// value_type and static identity(), lift(const Type&) and combine(a, b).
+// combine has to be associative but not necessarily commutative,
+// aggregates are always combined in order.
+template<class Type, class Monoid = NoMonoid>
 class Tree {
 public:
+    using NodeType = Node<Type, Monoid>;
+    using NodePtr = UPtrNode<Type, Monoid>;
+
     Tree() : root(nullptr)
     { }
 
-    Tree(UPtrNode<Type> node) : root(node)
-    { }
+    // Takes over a structure built elsewhere; cached state is rebuilt
+    // on first use, as after setRoot().
+    Tree(NodePtr node) : root(std::move(node))
+    {
+        invalidateCaches();
+    }
 
     Tree(const Tree& other) = delete;
     Tree& operator= (const Tree& other) = delete;
 
-    Tree(Tree&& other) = default;
-    Tree& operator=(Tree&& other) = default;
+    // The moved-from tree is left empty and usable.
+    Tree(Tree&& other) :
+        root(std::move(other.root)),
+        finger(other.finger),
+        generation(other.generation),
+        leftmost(other.leftmost),
+        rightmost(other.rightmost),
+        elementCount(other.elementCount),
+        linksValid(other.linksValid),
+        countValid(other.countValid),
+        summariesValid(other.summariesValid)
+    {
+        finger.owner = this;
+        other.clearState();
+    }
+
+    Tree& operator=(Tree&& other) {
+        if (this != &other) {
+            root = std::move(other.root);
+            // fingers into either old shape must not match the new one
+            generation = std::max(generation, other.generation) + 1;
+            finger = other.finger;
+            finger.generation = generation;
+            leftmost = other.leftmost;
+            rightmost = other.rightmost;
+            elementCount = other.elementCount;
+            linksValid = other.linksValid;
+            countValid = other.countValid;
+            summariesValid = other.summariesValid;
+            finger.owner = this;
+            other.clearState();
+        }
+        return *this;
+    }
 
     ~Tree() = default;
 
-    UPtrNode<Type>& getRoot() {
+    // The root is handed out for direct editing, so the remembered insert
+    // position, parent links, min/max and subtree aggregates can no longer
+    // be trusted after this call; they are rebuilt on next use in O(n).
+    // Use peekRoot() for read-only access.
+    NodePtr& getRoot() {
+        invalidateCaches();
         return root;
     }
 
-    void setRoot(UPtrNode<Type> node) {
+    // Read access for callers that run their own descents;
+    // unlike getRoot() it keeps the cached state. The nodes are handed out
+    // for reading only: relinking them or changing their content through
+    // it leaves min/max, the count, the summaries and the remembered insert
+    // position stale, and the behaviour of the tree is then undefined.
+    // Use getRoot() to edit the structure.
+    NodeType* peekRoot() {
+        validateSummaries();
+        return root.get();
+    }
+
+    void setRoot(NodePtr node) {
+        invalidateCaches();
         root = std::move(node);
     }
 
+    // Position of a node together with the range of elements that belong
+    // to its subtree: lower < el <= upper, a nullptr bound is open.
+    // A finger is stamped with the generation of the tree's shape. Plain
+    // insertions keep it; anything that relinks existing nodes (removals,
+    // pops, erase(), bulk builds, merge(), split(), join(), setRoot(),
+    // deserialize(), getRoot() and move-assignment) starts a new
+    // generation, and older fingers are then ignored in favour of a
+    // descent from the root.
+    // So are fingers into another tree, which is why it records its owner.
+    struct Finger {
+        NodeType* node = nullptr;
+        const Type* lower = nullptr;
+        const Type* upper = nullptr;
+        std::size_t generation = 0;
+        const Tree* owner = nullptr;
+    };
+
+    // Finger at the root of the current shape, to start own descents from;
+    // its nodes must not be relinked, see peekRoot().
+    Finger root_finger() {
+        return Finger{ peekRoot(), nullptr, nullptr, generation, this };
+    }
+
+    // Starts the descent at the position of the previous insertion when
+    // el falls into its range, so sorted streams are appended in O(1).
     void insert(const Type& el) {
-        addNode(getRoot(), std::move(Node<Type>::makeNode(el)));
+        finger = attach(finger, NodeType::makeNode(el));
+    }
+
+    // Inserts el starting the descent at hint if el belongs to its range,
+    // from the root otherwise. Returns the position of the new element,
+    // to be passed as the hint of the next insertion.
+    Finger insert(const Finger& hint, const Type& el) {
+        finger = attach(hint, NodeType::makeNode(el));
+        return finger;
+    }
+
+    void insert(Type&& el) {
+        finger = attach(finger, NodeType::makeNode(std::move(el)));
+    }
+
+    Finger insert(const Finger& hint, Type&& el) {
+        finger = attach(hint, NodeType::makeNode(std::move(el)));
+        return finger;
+    }
+
+    // Constructs the element from args directly in the storage of its node.
+    template<class... Args>
+    void emplace(Args&&... args) {
+        finger = attach(finger, NodeType::makeNode(std::forward<Args>(args)...));
+    }
+
+    template<class... Args>
+    Finger emplace_hint(const Finger& hint, Args&&... args) {
+        finger = attach(hint, NodeType::makeNode(std::forward<Args>(args)...));
+        return finger;
+    }
+
+    // Replaces the contents with the sorted range [first, last) arranged
+    // as a balanced tree, in O(n). Equal elements have to stay on the left
+    // of each other, so only long runs of them make the result deeper.
+    template<class ForwardIt>
+    void build_sorted(ForwardIt first, ForwardIt last) {
+        std::vector<NodePtr> nodes;
+        nodes.reserve(static_cast<std::size_t>(std::distance(first, last)));
+        for (; first != last; ++first) {
+            nodes.push_back(NodeType::makeNode(*first));
+        }
+        rebuild(nodes);
+    }
+
+    // Inserts the elements of [first, last), in any order. The batch is
+    // sorted, merged with the contents and the result rebuilt balanced,
+    // so k elements cost O(n + k log k) with sequential access instead of
+    // k descents; worth it once k is not negligible next to n.
+    template<class InputIt>
+    void insert_batch(InputIt first, InputIt last) {
+        std::vector<NodePtr> batch;
+        for (; first != last; ++first) {
+            batch.push_back(NodeType::makeNode(*first));
+        }
+        std::stable_sort(batch.begin(), batch.end(), [](const NodePtr& a, const NodePtr& b) {
+            return !(b->getContent() <= a->getContent());
+        });
+        mergeSorted(batch);
+    }
+
+    // Moves all elements of other into this tree, leaving other empty.
+    // Both in-order sequences are merged and relinked balanced in
+    // O(n + m); nodes and elements are reused, not copied.
+    void merge(Tree&& other) {
+        if (&other == this)
+            return;
+        std::vector<NodePtr> nodes;
+        mergeSorted(nodes, &other);
     }
 
     bool empty() {
-        return getRoot() == nullptr;
+        return root == nullptr;
+    }
+
+    // Number of elements, kept up to date by every change made through
+    // the tree; recounted in O(n) after getRoot() and split().
+    std::size_t size() {
+        validateCount();
+        return elementCount;
+    }
+
+    // Moves the elements greater than key into the returned tree and
+    // keeps the rest. Nodes are relinked along a single path from the
+    // root, O(height); only the sizes of both parts are left to be
+    // recounted by the next size().
+    Tree split(const Type& key) {
+        validateLinks();
+        Tree greater;
+        greater.summariesValid = summariesValid;
+        greater.generation = generation + 1;
+        greater.countValid = countValid = false;
+        reshape();
+        auto node = std::move(root);
+        // where the next node of either part is hooked in, and below what
+        auto keepSlot = &root;
+        auto keepParent = static_cast<NodeType*>(nullptr);
+        auto moveSlot = &greater.root;
+        auto moveParent = static_cast<NodeType*>(nullptr);
+        while (node) {
+            if (node->getContent() <= key) {
+                // so is its whole left subtree
+                auto next = std::move(node->getRight());
+                node->setParent(keepParent);
+                *keepSlot = std::move(node);
+                keepParent = keepSlot->get();
+                keepSlot = &keepParent->getRight();
+                node = std::move(next);
+            }
+            else {
+                auto next = std::move(node->getLeft());
+                node->setParent(moveParent);
+                *moveSlot = std::move(node);
+                moveParent = moveSlot->get();
+                moveSlot = &moveParent->getLeft();
+                node = std::move(next);
+            }
+        }
+        // nodes along the path are the only ones whose subtrees changed
+        if (summariesValid) {
+            refreshUpwards(keepParent);
+            greater.refreshUpwards(moveParent);
+        }
+        leftmost = root ? leftmostOf(root.get()) : nullptr;
+        rightmost = root ? rightmostOf(root.get()) : nullptr;
+        greater.leftmost = greater.root ? leftmostOf(greater.root.get()) : nullptr;
+        greater.rightmost = greater.root ? rightmostOf(greater.root.get()) : nullptr;
+        return greater;
+    }
+
+    // Concatenates two trees where every element of left is less than
+    // every element of right, leaving both empty. The greatest element of
+    // left becomes the root above both, O(height of left). Throws if the
+    // trees overlap, in which case neither is changed.
+    static Tree join(Tree&& left, Tree&& right) {
+        left.validateLinks();
+        right.validateLinks();
+        if (!right.root)
+            return std::move(left);
+        if (!left.root)
+            return std::move(right);
+        if (right.leftmost->getContent() <= left.rightmost->getContent()) {
+            throw std::runtime_error("Joined trees overlap");
+        }
+        Tree joined;
+        joined.generation = std::max(left.generation, right.generation) + 1;
+        joined.countValid = left.countValid && right.countValid;
+        joined.elementCount = left.elementCount + right.elementCount;
+        joined.summariesValid = left.summariesValid && right.summariesValid;
+        joined.root = left.unlinkNode(left.rightmost);
+        joined.root->setLeft(std::move(left.root));
+        joined.root->setRight(std::move(right.root));
+        if (joined.summariesValid)
+            refresh(joined.root.get(), IsAugmented());
+        joined.leftmost = leftmostOf(joined.root.get());
+        joined.rightmost = right.rightmost;
+        left.clearState();
+        right.clearState();
+        return joined;
     }
 
     void remove(const Type& el) {
-        if (!getRoot()) {
-            throw runtime_error("Trying to remove from empty tree");
-        }
-        if (getRoot()->getContent() == el) {
-            auto detachedRightSubtree = std::move(getRoot()->getRight());
-            auto detachedLeftSubtree = std::move(getRoot()->getLeft());
-            setRoot(std::move(detachedLeftSubtree));
-            addNode(getRoot(), std::move(detachedRightSubtree));
-            return;
+        if (!root) {
+            throw std::runtime_error("Trying to remove from empty tree");
         }
-        auto currentRoot = getRoot().get();
-        while (currentRoot != nullptr) {
-            auto child = el <= currentRoot->getContent() ?
-                currentRoot->getLeft().get() :
-                currentRoot->getRight().get();
-            if (child != nullptr && child->getContent() == el)
-                break;
-            else
-                currentRoot = child;
+        auto status = unlink(el);
+        if (status == Unlinked::EmptyNode) {
+            throw std::runtime_error("Reading content of empty node");
         }
-        if (currentRoot == nullptr) {
+        if (status == Unlinked::NotFound) {
             throw std::runtime_error("Element not found");
         }
-        //detach target node from tree
-        auto target = currentRoot->getLeft()->getContent() == el ?
-            std::move(currentRoot->getLeft()) :
-            std::move(currentRoot->getRight());
+    }
 
-        if (target->isLeaf()) {
-            target.reset();
+    // Non-throwing remove: returns false if el is not in the tree, or if
+    // the descent runs into a node without content.
+    // Element comparisons are expected not to throw.
+    bool try_remove(const Type& el) noexcept {
+        return unlink(el) == Unlinked::Done;
+    }
+
+    // Pointer to an element equal to el, or nullptr; never throws.
+    // A node without content on the way ends the lookup as a miss.
+    const Type* try_find(const Type& el) noexcept {
+        for (auto node = root.get(); node != nullptr;) {
+            auto contentPtr = node->getContentPtr();
+            if (contentPtr == nullptr)
+                return nullptr;
+            const auto& content = *contentPtr;
+            if (el == content)
+                return &content;
+            node = el <= content ?
+                node->getLeft().get() :
+                node->getRight().get();
+        }
+        return nullptr;
+    }
+
+    // Smallest element in O(1), or nullptr for an empty tree.
+    const Type* min() {
+        validateLinks();
+        return leftmost == nullptr ? nullptr : &leftmost->getContent();
+    }
+
+    // Greatest element in O(1), or nullptr for an empty tree.
+    const Type* max() {
+        validateLinks();
+        return rightmost == nullptr ? nullptr : &rightmost->getContent();
+    }
+
+    // Removes and returns the smallest element. The leftmost node has no
+    // left child, so it is unlinked in place without a descent.
+    Type pop_min() {
+        validateLinks();
+        if (!root) {
+            throw std::runtime_error("Trying to pop from empty tree");
+        }
+        return std::move(*unlinkNode(leftmost)->releaseContent());
+    }
+
+    // Removes and returns the greatest element, see pop_min().
+    Type pop_max() {
+        validateLinks();
+        if (!root) {
+            throw std::runtime_error("Trying to pop from empty tree");
+        }
+        return std::move(*unlinkNode(rightmost)->releaseContent());
+    }
+
+    // Aggregate of all elements, Monoid::identity() for an empty tree.
+    template<class M = Monoid>
+    typename M::value_type reduce() {
+        validateSummaries();
+        return summaryOf(root.get());
+    }
+
+    // Aggregate of the elements lo <= el <= hi, combined in order.
+    // Whole subtrees inside the range contribute their cached summary,
+    // so only the two boundary paths are walked: O(height).
+    template<class M = Monoid>
+    typename M::value_type reduce(const Type& lo, const Type& hi) {
+        validateSummaries();
+        // topmost node inside the range, where the boundary paths split
+        auto split = root.get();
+        while (split != nullptr) {
+            if (!(lo <= split->getContent()))
+                split = split->getRight().get();
+            else if (!(split->getContent() <= hi))
+                split = split->getLeft().get();
+            else
+                break;
+        }
+        if (split == nullptr)
+            return Monoid::identity();
+        auto below = Monoid::identity();
+        for (auto node = split->getLeft().get(); node != nullptr;) {
+            if (lo <= node->getContent()) {
+                below = Monoid::combine(Monoid::combine(
+                    Monoid::lift(node->getContent()), summaryOf(node->getRight().get())), below);
+                node = node->getLeft().get();
+            }
+            else {
+                node = node->getRight().get();
+            }
+        }
+        auto above = Monoid::identity();
+        for (auto node = split->getRight().get(); node != nullptr;) {
+            if (node->getContent() <= hi) {
+                above = Monoid::combine(above, Monoid::combine(
+                    summaryOf(node->getLeft().get()), Monoid::lift(node->getContent())));
+                node = node->getRight().get();
+            }
+            else {
+                node = node->getLeft().get();
+            }
+        }
+        return Monoid::combine(Monoid::combine(below, Monoid::lift(split->getContent())), above);
+    }
+
+    // Looks up keys[0..count) and stores a pointer to the matching element,
+    // or nullptr if there is none, into results[i]. Lookups are advanced in
+    // lock-step in groups of BatchSize, prefetching the next node of every
+    // pending lookup before comparing, so their cache misses overlap.
+    void find_batch(const Type* keys, std::size_t count, const Type** results) {
+        for (std::size_t base = 0; base < count; base += BatchSize) {
+            findGroup(keys + base, std::min(std::size_t{ BatchSize }, count - base), results + base);
+        }
+    }
+
+    // Same contract as find_batch, but lookups don't wait for each other:
+    // up to BatchSize of them are in flight, each one is stepped a single
+    // node per round and the slot of a finished lookup is immediately
+    // refilled with the next key. This keeps the pipeline full when
+    // descents have very different depths, which is the common case in
+    // an unbalanced tree.
+    void find_interleaved(const Type* keys, std::size_t count, const Type** results) {
+        struct Probe {
+            std::size_t index;
+            NodeType* node;
+            bool payloadRequested;
+        };
+        Probe probes[BatchSize];
+        std::size_t inFlight = 0;
+        std::size_t next = 0;
+        auto start = [&](Probe& probe) {
+            probe.index = next++;
+            probe.node = root.get();
+            probe.payloadRequested = false;
+            results[probe.index] = nullptr;
+            prefetch(probe.node);
+        };
+        if (!root) {
+            std::fill(results, results + count, nullptr);
             return;
         }
-        // always set left child as a new root of subtree.
-        if (target->getContent() <= currentRoot->getContent()) {
-            currentRoot->setLeft(std::move(target->getLeft()));
+        while (inFlight < BatchSize && next < count) {
+            start(probes[inFlight++]);
         }
-        else {
-            currentRoot->setRight(std::move(target->getLeft()));
+        while (inFlight > 0) {
+            for (std::size_t j = 0; j < inFlight;) {
+                auto& probe = probes[j];
+                if (!probe.payloadRequested) {
+                    prefetch(probe.node->getContentPtr());
+                    probe.payloadRequested = true;
+                    ++j;
+                    continue;
+                }
+                const auto& key = keys[probe.index];
+                const auto& content = probe.node->getContent();
+                auto child = static_cast<NodeType*>(nullptr);
+                if (key == content) {
+                    results[probe.index] = &content;
+                }
+                else {
+                    child = key <= content ?
+                        probe.node->getLeft().get() :
+                        probe.node->getRight().get();
+                }
+                if (child != nullptr) {
+                    probe.node = child;
+                    probe.payloadRequested = false;
+                    prefetch(child);
+                    ++j;
+                }
+                else if (next < count) {
+                    start(probe);
+                    ++j;
+                }
+                else {
+                    probe = probes[--inFlight];
+                }
+            }
         }
-        // right subtree of targer node will go down 
-        // and find a good place for yourself
-        if (target->getRight()) {
-            addNode(currentRoot->getLeft(), std::move(target->getRight()));
+    }
+
+    // Greatest element <= key, or nullptr.
+    const Type* floor(const Type& key) {
+        const Type* candidate = nullptr;
+        for (auto node = root.get(); node != nullptr;) {
+            if (node->getContent() <= key) {
+                candidate = &node->getContent();
+                node = node->getRight().get();
+            }
+            else {
+                node = node->getLeft().get();
+            }
+        }
+        return candidate;
+    }
+
+    // Smallest element >= key, or nullptr.
+    const Type* ceiling(const Type& key) {
+        const Type* candidate = nullptr;
+        for (auto node = root.get(); node != nullptr;) {
+            if (key <= node->getContent()) {
+                candidate = &node->getContent();
+                node = node->getLeft().get();
+            }
+            else {
+                node = node->getRight().get();
+            }
+        }
+        return candidate;
+    }
+
+    // Greatest element strictly less than key, or nullptr.
+    const Type* predecessor(const Type& key) {
+        const Type* candidate = nullptr;
+        for (auto node = root.get(); node != nullptr;) {
+            if (key <= node->getContent()) {
+                node = node->getLeft().get();
+            }
+            else {
+                candidate = &node->getContent();
+                node = node->getRight().get();
+            }
+        }
+        return candidate;
+    }
+
+    // Smallest element strictly greater than key, or nullptr.
+    const Type* successor(const Type& key) {
+        const Type* candidate = nullptr;
+        for (auto node = root.get(); node != nullptr;) {
+            if (node->getContent() <= key) {
+                node = node->getRight().get();
+            }
+            else {
+                candidate = &node->getContent();
+                node = node->getLeft().get();
+            }
+        }
+        return candidate;
+    }
+
+    // Up to k elements closest to key by distance(key, element), closest
+    // first; on a tie the smaller element wins. Walks outwards from the
+    // position of key in both directions, O(height + k).
+    template<class Distance>
+    std::vector<const Type*> nearest_k(const Type& key, std::size_t k, Distance distance) {
+        std::vector<const Type*> nearest;
+        // pending ancestors in order, the closest one on top
+        std::vector<NodeType*> above;
+        std::vector<NodeType*> below;
+        for (auto node = root.get(); node != nullptr;) {
+            if (key <= node->getContent()) {
+                above.push_back(node);
+                node = node->getLeft().get();
+            }
+            else {
+                below.push_back(node);
+                node = node->getRight().get();
+            }
+        }
+        nearest.reserve(k);
+        while (nearest.size() < k && (!above.empty() || !below.empty())) {
+            auto takeAbove = below.empty() || (!above.empty() &&
+                distance(key, above.back()->getContent()) <
+                distance(key, below.back()->getContent()));
+            if (takeAbove) {
+                auto node = above.back();
+                above.pop_back();
+                nearest.push_back(&node->getContent());
+                for (auto next = node->getRight().get(); next != nullptr; next = next->getLeft().get()) {
+                    above.push_back(next);
+                }
+            }
+            else {
+                auto node = below.back();
+                below.pop_back();
+                nearest.push_back(&node->getContent());
+                for (auto next = node->getLeft().get(); next != nullptr; next = next->getRight().get()) {
+                    below.push_back(next);
+                }
+            }
+        }
+        return nearest;
+    }
+
+    // In-order bidirectional iterator over parent links: a step is O(1)
+    // amortized and needs no extra storage. Insertions keep iterators
+    // valid, removals invalidate only those at the removed element.
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Type*;
+        using reference = const Type&;
+
+        Iterator() = default;
+
+        reference operator*() const {
+            return node->getContent();
+        }
+
+        pointer operator->() const {
+            return &node->getContent();
+        }
+
+        Iterator& operator++() {
+            node = successorOf(node);
+            return *this;
+        }
+
+        Iterator& operator--() {
+            node = node == nullptr ? tree->rightmost : predecessorOf(node);
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto old = *this;
+            ++*this;
+            return old;
+        }
+
+        Iterator operator--(int) {
+            auto old = *this;
+            --*this;
+            return old;
         }
+
+        bool operator==(const Iterator& that) const {
+            return node == that.node;
+        }
+
+        bool operator!=(const Iterator& that) const {
+            return !(*this == that);
+        }
+
+    private:
+        friend class Tree;
+
+        Iterator(Tree* owner, NodeType* position) :
+            tree(owner), node(position)
+        { }
+
+        Tree* tree = nullptr;
+        NodeType* node = nullptr;
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+    using reverse_iterator = std::reverse_iterator<Iterator>;
+    using const_reverse_iterator = reverse_iterator;
+
+    Iterator begin() {
+        validateLinks();
+        return Iterator(this, leftmost);
+    }
+
+    Iterator end() {
+        validateLinks();
+        return Iterator(this, nullptr);
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    // Removes the element at position without descending from the root,
+    // returns the iterator following it.
+    Iterator erase(Iterator position) {
+        validateLinks();
+        auto next = std::next(position);
+        unlinkNode(position.node);
+        return next;
     }
 
+    // Depth-first orders walk the parent links and use O(1) extra memory,
+    // whatever the height of the tree. LevelOrder goes breadth-first and
+    // needs a frontier as wide as the widest level.
     enum class TraverseType {
         PreOrder,
         InOrder,
-        PostOrder
+        PostOrder,
+        LevelOrder
     };
 
     void traverse(TraverseType type, std::function<void(Type)> visit) {
         if (type == TraverseType::PreOrder) {
-            preOrderTraversal(visit);
+            traverse<TraverseType::PreOrder>(visit);
         }
         else if (type == TraverseType::InOrder) {
-            inOrderTraversal(visit);
+            traverse<TraverseType::InOrder>(visit);
+        }
+        else if (type == TraverseType::PostOrder) {
+            traverse<TraverseType::PostOrder>(visit);
         }
-        else { // type == TraverseType::PostOrder
-            postOrderTraversal(visit);
+        else { // type == TraverseType::LevelOrder
+            traverse<TraverseType::LevelOrder>(visit);
         }
     }
 
+    // Calls visit(const Type&) on every element. The order is fixed at
+    // compile time and the visitor is taken by its own type, so the walk
+    // and the visitor can be inlined into a single loop.
+    template<TraverseType Order, class Visitor>
+    void traverse(Visitor&& visit) {
+        walk(visit, OrderTag<Order>());
+    }
+
+    // In-order walk for trees much larger than the cache. Going down a left
+    // spine it requests the payload and the right child of every node it
+    // passes, and the children of that right child just before the node is
+    // visited, so these loads overlap with the descent and with visit()
+    // instead of stalling the walk one at a time.
+    template<class Visitor>
+    void traverse_prefetched(Visitor&& visit) {
+        validateLinks();
+        auto node = root ? descendPrefetching(root.get()) : nullptr;
+        while (node != nullptr) {
+            if (node->hasRight()) {
+                auto right = node->getRight().get();
+                prefetch(right->getLeft().get());
+                prefetch(right->getRight().get());
+            }
+            visit(node->getContent());
+            node = node->hasRight() ?
+                descendPrefetching(node->getRight().get()) :
+                successorAbove(node);
+        }
+    }
+
+    // Copies the elements in order to out and returns the end of the
+    // output; size() tells how much room the destination needs.
+    template<class OutputIt>
+    OutputIt export_sorted(OutputIt out) {
+        traverse_prefetched([&out](const Type& el) {
+            *out = el;
+            ++out;
+        });
+        return out;
+    }
+
+    // Columnar export: appends key(el) to keys and payload(el) to payloads
+    // for every element in order, both arrays growing by size() elements
+    // with a single allocation each.
+    template<class K, class P, class KeyOf, class PayloadOf>
+    void export_columns(std::vector<K>& keys, std::vector<P>& payloads, KeyOf key, PayloadOf payload) {
+        keys.reserve(keys.size() + size());
+        payloads.reserve(payloads.size() + size());
+        traverse_prefetched([&](const Type& el) {
+            keys.push_back(key(el));
+            payloads.push_back(payload(el));
+        });
+    }
+
+    // Like traverse<Order>(), but gathers pointers to up to ChunkSize
+    // elements in a local buffer and hands them over at once as
+    // visit(const Type* const* elements, std::size_t count); only the last
+    // chunk may be shorter. The pointers are valid for the duration of the call.
+    // Depth-first orders only.
+    template<TraverseType Order, std::size_t ChunkSize = 64, class Visitor>
+    void traverse_chunked(Visitor&& visit) {
+        static_assert(Order != TraverseType::LevelOrder, "depth-first orders only");
+        static_assert(ChunkSize > 0, "chunks can't be empty");
+        validateLinks();
+        const Type* chunk[ChunkSize];
+        std::size_t count = 0;
+        for (auto node = firstNode(OrderTag<Order>()); node != nullptr;
+            node = nextNode(node, OrderTag<Order>())) {
+            chunk[count++] = &node->getContent();
+            if (count == ChunkSize) {
+                visit(static_cast<const Type* const*>(chunk), count);
+                count = 0;
+            }
+        }
+        if (count > 0)
+            visit(static_cast<const Type* const*>(chunk), count);
+    }
+
+    // What a pruning visitor wants the walk to do next.
+    enum class Control {
+        Continue,
+        // don't visit what is left of the current node's subtree: both
+        // children in pre-order, the right one in in-order; in post-order
+        // the subtree is already done and this is the same as Continue
+        SkipSubtree,
+        Stop
+    };
+
+    // Like traverse<Order>(), but visit(const Type&) returns a Control.
+    // Returns false if the walk was stopped. Depth-first orders only.
+    template<TraverseType Order, class Visitor>
+    bool traverse_pruned(Visitor&& visit) {
+        static_assert(Order != TraverseType::LevelOrder, "depth-first orders only");
+        validateLinks();
+        for (auto node = firstNode(OrderTag<Order>()); node != nullptr;) {
+            auto control = visit(node->getContent());
+            if (control == Control::Stop)
+                return false;
+            node = control == Control::SkipSubtree ?
+                skipNode(node, OrderTag<Order>()) :
+                nextNode(node, OrderTag<Order>());
+        }
+        return true;
+    }
+
+    // Depth-first walk pulled by the caller. The range holds only the first
+    // node and its iterators step along parent links, so any number of
+    // walks, over one tree or several, can be advanced side by side without
+    // buffering. Changing the tree invalidates the walk like an Iterator.
+    template<TraverseType Order>
+    class Walk {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Type*;
+            using reference = const Type&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return node->getContent();
+            }
+
+            pointer operator->() const {
+                return &node->getContent();
+            }
+
+            iterator& operator++() {
+                node = nextNode(node, OrderTag<Order>());
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const iterator& that) const {
+                return node == that.node;
+            }
+
+            bool operator!=(const iterator& that) const {
+                return !(*this == that);
+            }
+
+        private:
+            friend class Walk;
+
+            explicit iterator(NodeType* position) :
+                node(position)
+            { }
+
+            NodeType* node = nullptr;
+        };
+
+        iterator begin() const {
+            return iterator(first);
+        }
+
+        iterator end() const {
+            return iterator(nullptr);
+        }
+
+    private:
+        friend class Tree;
+
+        explicit Walk(NodeType* start) :
+            first(start)
+        { }
+
+        NodeType* first;
+    };
+
+    Walk<TraverseType::PreOrder> pre_order() {
+        return makeWalk<TraverseType::PreOrder>();
+    }
+
+    Walk<TraverseType::InOrder> in_order() {
+        return makeWalk<TraverseType::InOrder>();
+    }
+
+    Walk<TraverseType::PostOrder> post_order() {
+        return makeWalk<TraverseType::PostOrder>();
+    }
+
+    // Scratch storage of a breadth-first walk. Keeping one around and
+    // passing it to every traverse_levels() call makes the walks
+    // allocation-free once it has grown to the widest level.
+    class Frontier {
+    private:
+        friend class Tree;
+        std::vector<NodeType*> current;
+        std::vector<NodeType*> next;
+    };
+
+    // Breadth-first walk, calls visit(const Type&) left to right on each level.
+    template<class Visitor>
+    void traverse_levels(Frontier& frontier, Visitor&& visit) {
+        traverse_levels(frontier, visit, [](std::size_t, std::size_t) { });
+    }
+
+    // Same, and calls level(depth, width) before the elements of every
+    // level, the root being at depth 0.
+    template<class Visitor, class LevelVisitor>
+    void traverse_levels(Frontier& frontier, Visitor&& visit, LevelVisitor&& level) {
+        auto& current = frontier.current;
+        auto& next = frontier.next;
+        current.clear();
+        if (root)
+            current.push_back(root.get());
+        for (std::size_t depth = 0; !current.empty(); ++depth) {
+            level(depth, current.size());
+            next.clear();
+            for (auto node : current) {
+                visit(node->getContent());
+                if (node->hasLeft())
+                    next.push_back(node->getLeft().get());
+                if (node->hasRight())
+                    next.push_back(node->getRight().get());
+            }
+            current.swap(next);
+        }
+    }
+
+    // Folds map(const Type&) over all elements with combine(R, R) on up to
+    // threads threads. The top levels of the tree are cut into subtrees and
+    // single nodes that are reduced independently, and their results are
+    // combined in order, so combine only has to be associative. How evenly
+    // the work spreads follows how balanced the top of the tree is.
+    // map and combine are called concurrently and must not change the tree;
+    // an exception thrown by either is rethrown here.
+    template<class R, class Map, class Combine>
+    R parallel_reduce(R identity, Map map, Combine combine,
+        unsigned threads = std::thread::hardware_concurrency()) {
+        auto pieces = forkPieces(threads);
+        std::vector<R> partial(pieces.size(), identity);
+        runPieces(pieces, threads, [&](std::size_t i) {
+            auto result = identity;
+            forEachIn(pieces[i], [&](const Type& el) {
+                result = combine(std::move(result), map(el));
+            });
+            partial[i] = std::move(result);
+        });
+        auto result = std::move(identity);
+        for (auto& part : partial) {
+            result = combine(std::move(result), std::move(part));
+        }
+        return result;
+    }
+
+    // Calls visit(const Type&) on every element from up to threads threads,
+    // in no particular order. visit must not change the tree.
+    template<class Visitor>
+    void parallel_for_each(Visitor visit,
+        unsigned threads = std::thread::hardware_concurrency()) {
+        auto pieces = forkPieces(threads);
+        runPieces(pieces, threads, [&](std::size_t i) {
+            forEachIn(pieces[i], visit);
+        });
+    }
+
     template<typename T>
     class is_serializable {
     private:
@@ -125,7 +987,7 @@ public:
     typename std::enable_if<is_serializable<U>::value, void>::type
     serialize(std::ostream& stream)
     {
-        serialize_impl(getRoot().get(), stream);
+        serialize_impl(root.get(), stream);
     }
 
     template<typename T>
@@ -147,88 +1009,603 @@ public:
     typename std::enable_if<is_deserializable<U>::value, void>::type
     deserialize(std::istream& stream)
     {
-        deserialize_impl(std::move(getRoot()), stream);
+        invalidateCaches();
+        deserialize_impl(root, stream);
     }
 
 private:
-    void addNode(UPtrNode<Type>& subroot, UPtrNode<Type> newNode) {
-        if (!subroot) {
-            subroot = std::move(newNode);
-            return;
+    static constexpr std::size_t BatchSize = 16;
+
+    void findGroup(const Type* keys, std::size_t count, const Type** results) {
+        NodeType* cursor[BatchSize];
+        std::size_t pending[BatchSize];
+        std::size_t inFlight = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            results[i] = nullptr;
+            if (root) {
+                cursor[i] = root.get();
+                pending[inFlight++] = i;
+            }
         }
-        auto currentRoot = subroot.get();
-        while (currentRoot != nullptr) {
-            auto branch = newNode->getContent() <= currentRoot->getContent() ?
-                currentRoot->getLeft().get() :
-                currentRoot->getRight().get();
-            if (branch == nullptr)
-                break;
-            else
-                currentRoot = branch;
+        if (inFlight > 0)
+            prefetch(root.get());
+        while (inFlight > 0) {
+            // node headers were requested on the previous round,
+            // now request the payloads they point to
+            for (std::size_t j = 0; j < inFlight; ++j) {
+                prefetch(cursor[pending[j]]->getContentPtr());
+            }
+            for (std::size_t j = 0; j < inFlight;) {
+                auto i = pending[j];
+                const auto& content = cursor[i]->getContent();
+                auto next = static_cast<NodeType*>(nullptr);
+                if (keys[i] == content) {
+                    results[i] = &content;
+                }
+                else {
+                    next = keys[i] <= content ?
+                        cursor[i]->getLeft().get() :
+                        cursor[i]->getRight().get();
+                }
+                if (next == nullptr) {
+                    pending[j] = pending[--inFlight];
+                    continue;
+                }
+                prefetch(next);
+                cursor[i] = next;
+                ++j;
+            }
         }
-        if (newNode->getContent() <= currentRoot->getContent()) {
-            currentRoot->setLeft(std::move(newNode));
+    }
+
+    using IsAugmented = std::integral_constant<bool, !std::is_same<Monoid, NoMonoid>::value>;
+    static constexpr bool Augmented = IsAugmented::value;
+
+    // Existing nodes are about to be relinked: fingers taken so far
+    // no longer describe the ranges of their nodes.
+    void reshape() {
+        finger = Finger();
+        ++generation;
+    }
+
+    void invalidateCaches() {
+        reshape();
+        linksValid = false;
+        countValid = false;
+        summariesValid = false;
+    }
+
+    // Cached state of an empty tree, for when root has been taken away.
+    void clearState() {
+        reshape();
+        leftmost = rightmost = nullptr;
+        elementCount = 0;
+        linksValid = true;
+        countValid = true;
+        summariesValid = Augmented;
+    }
+
+    static NodeType* leftmostOf(NodeType* node) {
+        while (node->hasLeft()) {
+            node = node->getLeft().get();
         }
-        else {
-            currentRoot->setRight(std::move(newNode));
+        return node;
+    }
+
+    static NodeType* rightmostOf(NodeType* node) {
+        while (node->hasRight()) {
+            node = node->getRight().get();
         }
+        return node;
     }
 
-    void preOrderTraversal(std::function<void(Type)> visit) {
-        std::stack<Node<Type>*> stack;
-        stack.push(getRoot().get());
-        while (!stack.empty()) {
-            auto node = stack.top();
-            stack.pop();
-            visit(node->getContent());
+    static NodeType* successorOf(NodeType* node) {
+        if (node->hasRight())
+            return leftmostOf(node->getRight().get());
+        return successorAbove(node);
+    }
+
+    // leftmostOf() that prefetches what the in-order walk needs
+    // after each node of the spine, see traverse_prefetched()
+    static NodeType* descendPrefetching(NodeType* node) {
+        for (;;) {
+            prefetch(node->getContentPtr());
             if (node->hasRight())
-                stack.push(node->getRight().get());
-            if (node->hasLeft())
-                stack.push(node->getLeft().get());
+                prefetch(node->getRight().get());
+            if (!node->hasLeft())
+                return node;
+            node = node->getLeft().get();
+        }
+    }
+
+    // In-order successor of the whole subtree of node: climb until
+    // we come up from a left child.
+    static NodeType* successorAbove(NodeType* node) {
+        auto parent = node->getParent();
+        while (parent != nullptr && parent->getRight().get() == node) {
+            node = parent;
+            parent = node->getParent();
         }
+        return parent;
     }
 
-    void inOrderTraversal(std::function<void(Type)> visit) {
-        std::stack<Node<Type>*> stack;
-        auto node = getRoot().get();
-        while (!stack.empty() || node != nullptr) {
-            if (node != nullptr) {
-                stack.push(node);
+    static NodeType* predecessorOf(NodeType* node) {
+        if (node->hasLeft())
+            return rightmostOf(node->getLeft().get());
+        auto parent = node->getParent();
+        while (parent != nullptr && parent->getLeft().get() == node) {
+            node = parent;
+            parent = node->getParent();
+        }
+        return parent;
+    }
+
+    // Restores parent links, the leftmost/rightmost nodes and the element
+    // count after the structure was handed out through getRoot(). The walk
+    // climbs back through the links it has just set, so it allocates nothing.
+    void validateLinks() {
+        if (linksValid)
+            return;
+        leftmost = rightmost = nullptr;
+        elementCount = 0;
+        if (root) {
+            root->setParent(nullptr);
+            leftmost = leftmostOf(root.get());
+            rightmost = rightmostOf(root.get());
+        }
+        auto node = root.get();
+        while (node != nullptr) {
+            ++elementCount;
+            if (node->hasLeft())
+                node->getLeft()->setParent(node);
+            if (node->hasRight())
+                node->getRight()->setParent(node);
+            if (node->hasLeft()) {
                 node = node->getLeft().get();
+                continue;
             }
-            else {
-                node = stack.top();
-                stack.pop();
-                visit(node->getContent());
+            if (node->hasRight()) {
                 node = node->getRight().get();
+                continue;
+            }
+            // leaf: go up to the first unvisited right sibling
+            for (;;) {
+                auto parent = node->getParent();
+                if (parent == nullptr) {
+                    node = nullptr;
+                    break;
+                }
+                if (parent->getLeft().get() == node && parent->hasRight()) {
+                    node = parent->getRight().get();
+                    break;
+                }
+                node = parent;
             }
         }
+        linksValid = true;
+        countValid = true;
     }
 
-    void postOrderTraversal(std::function<void(Type)> visit) {
-        std::stack<Node<Type>*> stack;
-        auto node = getRoot().get();
-        auto lastVisitedNode = static_cast<Node<Type>*>(nullptr);
-        while (!stack.empty() || node != nullptr) {
-            if (node != nullptr) {
-                stack.push(node);
-                node = node->getLeft().get();
+    void validateCount() {
+        validateLinks();
+        if (countValid)
+            return;
+        elementCount = 0;
+        for (auto node = leftmost; node != nullptr; node = successorOf(node)) {
+            ++elementCount;
+        }
+        countValid = true;
+    }
+
+    template<class M = Monoid>
+    static typename M::value_type summaryOf(NodeType* node) {
+        return node != nullptr ? node->getSummary() : Monoid::identity();
+    }
+
+    static void refresh(NodeType*, std::false_type) { }
+
+    // A node without content contributes nothing to the aggregate;
+    // refreshing must not throw since try_remove() gets here.
+    static void refresh(NodeType* node, std::true_type) {
+        auto contentPtr = node->getContentPtr();
+        auto own = contentPtr != nullptr ? Monoid::lift(*contentPtr) : Monoid::identity();
+        node->setSummary(Monoid::combine(Monoid::combine(
+            summaryOf(node->getLeft().get()), std::move(own)),
+            summaryOf(node->getRight().get())));
+    }
+
+    // Recomputes summaries from node up to the root.
+    void refreshUpwards(NodeType* node) {
+        for (; node != nullptr; node = node->getParent()) {
+            refresh(node, IsAugmented());
+        }
+    }
+
+    void validateSummaries() {
+        if (summariesValid || !Augmented)
+            return;
+        // summaries are refreshed upwards along parent links later on
+        validateLinks();
+        // post-order visits children before their parents and, walking
+        // the parent links, needs no extra memory
+        for (auto node = firstNode(OrderTag<TraverseType::PostOrder>()); node != nullptr;
+            node = postOrderNext(node)) {
+            refresh(node, IsAugmented());
+        }
+        summariesValid = true;
+    }
+
+    bool covers(const Finger& position, const Type& el) const {
+        return position.node != nullptr && position.owner == this &&
+            position.generation == generation &&
+            (position.lower == nullptr || !(el <= *position.lower)) &&
+            (position.upper == nullptr || el <= *position.upper);
+    }
+
+    // Links newNode as a leaf, descending from start if the element is in
+    // its range; the result is the same leaf a descent from root would find.
+    Finger attach(Finger start, NodePtr newNode) {
+        ++elementCount;
+        if (!root) {
+            root = std::move(newNode);
+            root->setParent(nullptr);
+            if (linksValid)
+                leftmost = rightmost = root.get();
+            if (summariesValid)
+                refresh(root.get(), IsAugmented());
+            return Finger{ root.get(), nullptr, nullptr, generation, this };
+        }
+        const auto& el = newNode->getContent();
+        if (!covers(start, el)) {
+            start = Finger{ root.get(), nullptr, nullptr, generation, this };
+        }
+        auto currentRoot = start.node;
+        auto leaf = static_cast<NodeType*>(nullptr);
+        while (leaf == nullptr) {
+            if (el <= currentRoot->getContent()) {
+                start.upper = &currentRoot->getContent();
+                if (!currentRoot->hasLeft()) {
+                    currentRoot->setLeft(std::move(newNode));
+                    leaf = currentRoot->getLeft().get();
+                    if (linksValid && leftmost == currentRoot)
+                        leftmost = leaf;
+                }
+                else {
+                    currentRoot = currentRoot->getLeft().get();
+                }
             }
             else {
-                auto peekNode = stack.top();
-                if (peekNode->getRight().get() != nullptr  && lastVisitedNode != peekNode->getRight().get())
-                    node = peekNode->getRight().get();
+                start.lower = &currentRoot->getContent();
+                if (!currentRoot->hasRight()) {
+                    currentRoot->setRight(std::move(newNode));
+                    leaf = currentRoot->getRight().get();
+                    if (linksValid && rightmost == currentRoot)
+                        rightmost = leaf;
+                }
                 else {
-                    visit(peekNode->getContent());
-                    lastVisitedNode = stack.top();
-                    stack.pop();
+                    currentRoot = currentRoot->getRight().get();
                 }
             }
         }
+        // summaries of all ancestors change
+        if (summariesValid)
+            refreshUpwards(leaf);
+        return Finger{ leaf, start.lower, start.upper, generation, this };
+    }
+
+    // Moves all nodes out in order, leaving the tree empty.
+    // Nothing can throw once the first node has been taken.
+    void drainNodes(std::vector<NodePtr>& nodes) {
+        validateCount();
+        nodes.reserve(nodes.size() + elementCount);
+        auto first = nodes.size();
+        for (auto node = leftmost; node != nullptr; node = successorOf(node)) {
+            nodes.emplace_back(node);
+        }
+        // every node is now owned by the vector
+        root.release();
+        for (auto i = first; i < nodes.size(); ++i) {
+            nodes[i]->getLeft().release();
+            nodes[i]->getRight().release();
+            nodes[i]->setParent(nullptr);
+        }
+        clearState();
+    }
+
+    // Rebuilds the tree from its own nodes and the sorted ones given,
+    // which end up in front of contained elements equal to them. All nodes
+    // of donor, if any, are appended to sorted first. Every allocation is
+    // made before either tree gives up a node.
+    void mergeSorted(std::vector<NodePtr>& sorted, Tree* donor = nullptr) {
+        validateCount();
+        auto incoming = sorted.size();
+        if (donor != nullptr) {
+            donor->validateCount();
+            incoming += donor->elementCount;
+            sorted.reserve(incoming);
+        }
+        if (incoming == 0)
+            return;
+        std::vector<NodePtr> merged;
+        merged.reserve(elementCount + incoming);
+        std::vector<NodePtr> own;
+        own.reserve(elementCount);
+        if (donor != nullptr)
+            donor->drainNodes(sorted);
+        drainNodes(own);
+        auto next = sorted.begin();
+        for (auto& node : own) {
+            for (; next != sorted.end() && (*next)->getContent() <= node->getContent(); ++next) {
+                merged.push_back(std::move(*next));
+            }
+            merged.push_back(std::move(node));
+        }
+        std::move(next, sorted.end(), std::back_inserter(merged));
+        rebuild(merged);
+    }
+
+    // Makes the sorted nodes the new contents, see build_sorted().
+    void rebuild(std::vector<NodePtr>& nodes) {
+        reshape();
+        elementCount = nodes.size();
+        countValid = true;
+        leftmost = nodes.empty() ? nullptr : nodes.front().get();
+        rightmost = nodes.empty() ? nullptr : nodes.back().get();
+        root.reset();
+        linkSorted(nodes.data(), nodes.size(), &root, nullptr);
+        linksValid = true;
+        // recomputed bottom-up on first use
+        summariesValid = false;
+    }
+
+    // Links the sorted nodes[0..n) below parent into slot. The middle
+    // node's run of equal elements closes with the subtree root so the
+    // right subtree holds greater elements only. Recursion goes right,
+    // where at most half of the nodes are left, and the left part is
+    // linked by the loop, so the stack stays O(log n) deep.
+    static void linkSorted(NodePtr* nodes, std::size_t n, NodePtr* slot, NodeType* parent) {
+        auto greater = [](const NodePtr& value, const NodePtr& node) {
+            return !(node->getContent() <= value->getContent());
+        };
+        while (n > 0) {
+            auto runEnd = std::upper_bound(nodes + n / 2 + 1, nodes + n, nodes[n / 2], greater);
+            auto top = static_cast<std::size_t>(runEnd - nodes) - 1;
+            *slot = std::move(nodes[top]);
+            auto node = slot->get();
+            node->setParent(parent);
+            linkSorted(nodes + top + 1, n - top - 1, &node->getRight(), node);
+            slot = &node->getLeft();
+            parent = node;
+            n = top;
+        }
+    }
+
+    enum class Unlinked {
+        Done,
+        NotFound,
+        // the descent reached a node without content
+        EmptyNode
+    };
+
+    // Detaches the node holding el. Reached from try_remove(), so nothing
+    // here may throw; remove() turns the status into its exceptions.
+    Unlinked unlink(const Type& el) {
+        auto node = root.get();
+        while (node != nullptr) {
+            auto content = node->getContentPtr();
+            if (content == nullptr)
+                return Unlinked::EmptyNode;
+            if (*content == el)
+                break;
+            node = el <= *content ?
+                node->getLeft().get() :
+                node->getRight().get();
+        }
+        if (node == nullptr)
+            return Unlinked::NotFound;
+        validateLinks();
+        unlinkNode(node);
+        return Unlinked::Done;
+    }
+
+    // Detaches node from the tree and hands it over. Its left child always
+    // becomes a new root of subtree, the right subtree goes down below the
+    // greatest node of the left one. Requires valid links.
+    NodePtr unlinkNode(NodeType* node) {
+        reshape();
+        --elementCount;
+        auto parent = node->getParent();
+        auto& slot = parent == nullptr ? root :
+            parent->getLeft().get() == node ? parent->getLeft() : parent->getRight();
+        auto target = std::move(slot);
+        // deepest node whose subtree changed
+        auto changed = parent;
+        if (target->hasLeft()) {
+            slot = std::move(target->getLeft());
+            if (target->hasRight()) {
+                changed = rightmostOf(slot.get());
+                changed->setRight(std::move(target->getRight()));
+            }
+        }
+        else {
+            slot = std::move(target->getRight());
+        }
+        if (slot)
+            slot->setParent(parent);
+        if (target.get() == leftmost)
+            leftmost = slot ? leftmostOf(slot.get()) : parent;
+        if (target.get() == rightmost)
+            rightmost = slot ? rightmostOf(slot.get()) : parent;
+        if (summariesValid)
+            refreshUpwards(changed);
+        target->setParent(nullptr);
+        return target;
+    }
+
+    // Next node in pre-order: first child, otherwise the right sibling
+    // of the nearest ancestor that still has one.
+    static NodeType* preOrderNext(NodeType* node) {
+        if (node->hasLeft())
+            return node->getLeft().get();
+        if (node->hasRight())
+            return node->getRight().get();
+        return preOrderAbove(node);
+    }
+
+    // First node in pre-order after the whole subtree of node.
+    static NodeType* preOrderAbove(NodeType* node) {
+        for (auto parent = node->getParent(); parent != nullptr; parent = node->getParent()) {
+            if (parent->getLeft().get() == node && parent->hasRight())
+                return parent->getRight().get();
+            node = parent;
+        }
+        return nullptr;
+    }
+
+    // first node of a subtree in post-order
+    static NodeType* deepestFirst(NodeType* node) {
+        for (;;) {
+            if (node->hasLeft())
+                node = node->getLeft().get();
+            else if (node->hasRight())
+                node = node->getRight().get();
+            else
+                return node;
+        }
+    }
+
+    static NodeType* postOrderNext(NodeType* node) {
+        auto parent = node->getParent();
+        if (parent != nullptr && parent->getLeft().get() == node && parent->hasRight())
+            return deepestFirst(parent->getRight().get());
+        return parent;
+    }
+
+    template<TraverseType Order>
+    using OrderTag = std::integral_constant<TraverseType, Order>;
+
+    template<class Visitor, TraverseType Order>
+    void walk(Visitor& visit, OrderTag<Order>) {
+        validateLinks();
+        for (auto node = firstNode(OrderTag<Order>()); node != nullptr;
+            node = nextNode(node, OrderTag<Order>())) {
+            visit(node->getContent());
+        }
+    }
+
+    template<class Visitor>
+    void walk(Visitor& visit, OrderTag<TraverseType::LevelOrder>) {
+        Frontier frontier;
+        traverse_levels(frontier, visit);
+    }
+
+    template<TraverseType Order>
+    Walk<Order> makeWalk() {
+        validateLinks();
+        return Walk<Order>(firstNode(OrderTag<Order>()));
+    }
+
+    NodeType* firstNode(OrderTag<TraverseType::PreOrder>) {
+        return root.get();
+    }
+
+    NodeType* firstNode(OrderTag<TraverseType::InOrder>) {
+        return leftmost;
+    }
+
+    NodeType* firstNode(OrderTag<TraverseType::PostOrder>) {
+        return root ? deepestFirst(root.get()) : nullptr;
+    }
+
+    static NodeType* nextNode(NodeType* node, OrderTag<TraverseType::PreOrder>) {
+        return preOrderNext(node);
+    }
+
+    static NodeType* nextNode(NodeType* node, OrderTag<TraverseType::InOrder>) {
+        return successorOf(node);
+    }
+
+    static NodeType* nextNode(NodeType* node, OrderTag<TraverseType::PostOrder>) {
+        return postOrderNext(node);
+    }
+
+    // Next node once the rest of the subtree of node is skipped.
+    static NodeType* skipNode(NodeType* node, OrderTag<TraverseType::PreOrder>) {
+        return preOrderAbove(node);
+    }
+
+    static NodeType* skipNode(NodeType* node, OrderTag<TraverseType::InOrder>) {
+        return successorAbove(node);
+    }
+
+    static NodeType* skipNode(NodeType* node, OrderTag<TraverseType::PostOrder>) {
+        return postOrderNext(node);
+    }
+
+    // Unit of parallel work: the whole subtree of node, or node alone.
+    struct Piece {
+        NodeType* node;
+        bool whole;
+    };
+
+    // Cuts the tree into pieces listed in order: a few per thread so that
+    // uneven subtrees still keep every thread busy.
+    std::vector<Piece> forkPieces(unsigned threads) {
+        validateLinks();
+        std::size_t depth = 0;
+        for (std::size_t wanted = 4 * std::max(threads, 1u); wanted > 1; wanted /= 2) {
+            ++depth;
+        }
+        std::vector<Piece> pieces;
+        cutPieces(root.get(), threads > 1 ? depth : 0, pieces);
+        return pieces;
+    }
+
+    static void cutPieces(NodeType* node, std::size_t depth, std::vector<Piece>& pieces) {
+        if (node == nullptr)
+            return;
+        if (depth == 0) {
+            pieces.push_back(Piece{ node, true });
+            return;
+        }
+        cutPieces(node->getLeft().get(), depth - 1, pieces);
+        pieces.push_back(Piece{ node, false });
+        cutPieces(node->getRight().get(), depth - 1, pieces);
+    }
+
+    // Calls work(i) for every piece, the calling thread takes part.
+    template<class Work>
+    static void runPieces(const std::vector<Piece>& pieces, unsigned threads, Work work) {
+        std::atomic<std::size_t> next(0);
+        auto worker = [&]() {
+            for (std::size_t i; (i = next++) < pieces.size();) {
+                work(i);
+            }
+        };
+        std::vector<std::future<void>> helpers;
+        for (std::size_t t = 1; t < std::min<std::size_t>(threads, pieces.size()); ++t) {
+            helpers.push_back(std::async(std::launch::async, worker));
+        }
+        worker();
+        for (auto& helper : helpers) {
+            helper.get();
+        }
+    }
 
+    // In-order walk of a piece.
+    template<class Visitor>
+    static void forEachIn(const Piece& piece, Visitor&& visit) {
+        if (!piece.whole) {
+            visit(piece.node->getContent());
+            return;
+        }
+        auto stop = successorAbove(piece.node);
+        for (auto node = leftmostOf(piece.node); node != stop; node = successorOf(node)) {
+            visit(node->getContent());
+        }
     }
 
-    void serialize_impl(Node<Type>* subroot, std::ostream& stream) {
+    void serialize_impl(NodeType* subroot, std::ostream& stream) {
         if (subroot == nullptr) {
             stream << "{ _NULL_ }";
             return;
@@ -240,7 +1617,7 @@ private:
         serialize_impl(subroot->getRight().get(), stream);
     }
 
-    void deserialize_impl(UPtrNode<Type>& subroot, std::istream& stream) {
+    void deserialize_impl(NodePtr& subroot, std::istream& stream) {
         int c;
         if ((c = stream.get()) != EOF) {
             if (c == '{') {
@@ -264,7 +1641,7 @@ private:
                         stream.seekg(pos);
                     }
                 }
-                subroot = std::move(Node<Type>::makeNode());
+                subroot = std::move(NodeType::makeNode());
                 auto tmp = std::make_unique<Type>();
                 tmp->deserialize(stream);
                 stream.get(); //skip ws
@@ -279,6 +1656,18 @@ private:
         }
     }
 
-    UPtrNode<Type> root;
+    NodePtr root;
+    Finger finger;
+    // bumped by reshape(), see Finger
+    std::size_t generation = 0;
+    NodeType* leftmost = nullptr;
+    NodeType* rightmost = nullptr;
+    std::size_t elementCount = 0;
+    // parent links, leftmost and rightmost can be trusted
+    bool linksValid = true;
+    // elementCount can be trusted, implies linksValid
+    bool countValid = true;
+    // every node caches the aggregate of its subtree, implies linksValid
+    bool summariesValid = Augmented;
 };
 #endif __TREE_HPP__
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef __TREEMAP_HPP__
+#define __TREEMAP_HPP__
+
+#include <tree.hpp>
+
+#include <utility>
+
+// Element of TreeMap: ordered and compared by key only. The value is
+// mutable so it can be changed in place without touching the ordering.
+template<class K, class V>
+struct MapEntry {
+    template<class... Args>
+    MapEntry(const K& k, Args&&... args) :
+        key(k), value(std::forward<Args>(args)...)
+    { }
+
+    bool operator==(const MapEntry& that) const {
+        return key == that.key;
+    }
+
+    bool operator<=(const MapEntry& that) const {
+        return key <= that.key;
+    }
+
+    K key;
+    mutable V value;
+};
+
+template<class K, class V>
+class TreeMap {
+public:
+    using Entry = MapEntry<K, V>;
+
+    TreeMap() = default;
+
+    TreeMap(const TreeMap& other) = delete;
+    TreeMap& operator=(const TreeMap& other) = delete;
+
+    TreeMap(TreeMap&& other) = default;
+    TreeMap& operator=(TreeMap&& other) = default;
+
+    Tree<Entry>& getTree() {
+        return tree;
+    }
+
+    bool empty() {
+        return tree.empty();
+    }
+
+    V* find(const K& key) {
+        auto position = locate(key);
+        return position.first ? &position.second.node->getContent().value : nullptr;
+    }
+
+    bool contains(const K& key) {
+        return find(key) != nullptr;
+    }
+
+    // Constructs the value from args only if key is absent.
+    // Returns the stored value and whether it was inserted.
+    template<class... Args>
+    std::pair<V*, bool> try_emplace(const K& key, Args&&... args) {
+        auto position = locate(key);
+        if (position.first) {
+            return { &position.second.node->getContent().value, false };
+        }
+        auto inserted = tree.emplace_hint(position.second, key, std::forward<Args>(args)...);
+        return { &inserted.node->getContent().value, true };
+    }
+
+    template<class M>
+    std::pair<V*, bool> insert_or_assign(const K& key, M&& value) {
+        auto position = locate(key);
+        if (position.first) {
+            auto& stored = position.second.node->getContent().value;
+            stored = std::forward<M>(value);
+            return { &stored, false };
+        }
+        auto inserted = tree.emplace_hint(position.second, key, std::forward<M>(value));
+        return { &inserted.node->getContent().value, true };
+    }
+
+    V& operator[](const K& key) {
+        return *try_emplace(key).first;
+    }
+
+    // Calls fn(value) on the value stored under key, in place.
+    // Returns false if there is no such key.
+    template<class Fn>
+    bool update(const K& key, Fn&& fn) {
+        auto value = find(key);
+        if (value == nullptr)
+            return false;
+        fn(*value);
+        return true;
+    }
+
+private:
+    // Single descent for key. Yields true and the matching node, or false
+    // and a hint covering the leaf position where key would be inserted.
+    std::pair<bool, typename Tree<Entry>::Finger> locate(const K& key) {
+        auto position = tree.root_finger();
+        while (position.node != nullptr) {
+            const auto& entry = position.node->getContent();
+            if (key == entry.key) {
+                return { true, position };
+            }
+            auto goLeft = key <= entry.key;
+            auto child = goLeft ?
+                position.node->getLeft().get() :
+                position.node->getRight().get();
+            if (child == nullptr) {
+                break;
+            }
+            if (goLeft)
+                position.upper = &entry;
+            else
+                position.lower = &entry;
+            position.node = child;
+        }
+        return { false, position };
+    }
+
+    Tree<Entry> tree;
+};
+
+#endif // __TREEMAP_HPP__
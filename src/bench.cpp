@@ -0,0 +1,115 @@
+#include <node.hpp>
+#include <tree.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Runs body once and returns the elapsed wall time in nanoseconds.
+template<class Body>
+double measure(Body body) {
+    auto start = chrono::steady_clock::now();
+    body();
+    auto stop = chrono::steady_clock::now();
+    return static_cast<double>(
+        chrono::duration_cast<chrono::nanoseconds>(stop - start).count());
+}
+
+void report(const string& name, double ns, size_t ops, size_t checksum) {
+    cout << name << ": " << ns / ops << " ns/op"
+        << " (checksum " << checksum << ")" << endl;
+}
+
+// Plain single-key descent, the way lookups are done through the Node API.
+const int* findSequential(Node<int>* node, int key) {
+    while (node != nullptr) {
+        if (node->getContent() == key)
+            return &node->getContent();
+        node = key <= node->getContent() ?
+            node->getLeft().get() :
+            node->getRight().get();
+    }
+    return nullptr;
+}
+
+size_t countFound(const vector<const int*>& results) {
+    size_t found = 0;
+    for (auto r : results) {
+        found += r != nullptr;
+    }
+    return found;
+}
+
+void benchLookups(Tree<int>& tree, const vector<int>& keys) {
+    vector<const int*> results(keys.size());
+    auto root = tree.peekRoot();
+
+    auto ns = measure([&] {
+        for (size_t i = 0; i < keys.size(); i++) {
+            results[i] = findSequential(root, keys[i]);
+        }
+    });
+    report("sequential lookups ", ns, keys.size(), countFound(results));
+
+    ns = measure([&] {
+        tree.find_batch(keys.data(), keys.size(), results.data());
+    });
+    report("find_batch         ", ns, keys.size(), countFound(results));
+
+    ns = measure([&] {
+        tree.find_interleaved(keys.data(), keys.size(), results.data());
+    });
+    report("find_interleaved   ", ns, keys.size(), countFound(results));
+}
+
+void benchTraversal(Tree<int>& tree, size_t nodes) {
+    long long sum = 0;
+    auto ns = measure([&] {
+        tree.traverse(Tree<int>::TraverseType::InOrder, [&sum](int v) { sum += v; });
+    });
+    report("traverse(std::function)", ns, nodes, static_cast<size_t>(sum));
+
+    sum = 0;
+    ns = measure([&] {
+        tree.traverse<Tree<int>::TraverseType::InOrder>([&sum](const int& v) { sum += v; });
+    });
+    report("traverse<InOrder>      ", ns, nodes, static_cast<size_t>(sum));
+
+    sum = 0;
+    ns = measure([&] {
+        tree.traverse_prefetched([&sum](const int& v) { sum += v; });
+    });
+    report("traverse_prefetched    ", ns, nodes, static_cast<size_t>(sum));
+}
+
+// usage: launch_bench [nodes] [lookups]
+// The default tree size is chosen to be well beyond a typical LLC.
+int main(int argc, char** argv) {
+    size_t nodes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4000000;
+    size_t lookups = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000000;
+
+    mt19937 gen(42);
+    uniform_int_distribution<int> dist(0, 1 << 30);
+
+    // random insertion order scatters nodes over the heap
+    Tree<int> tree;
+    vector<int> values(nodes);
+    for (auto& v : values) {
+        v = dist(gen);
+        tree.insert(v);
+    }
+    // every other key is known to be present
+    vector<int> keys(lookups);
+    for (size_t i = 0; i < lookups; i++) {
+        keys[i] = i % 2 == 0 ? values[gen() % nodes] : dist(gen);
+    }
+    cout << "tree of " << nodes << " nodes, " << lookups << " lookups" << endl;
+    benchLookups(tree, keys);
+    benchTraversal(tree, nodes);
+    return 0;
+}
@@ -1,8 +1,18 @@
+#include <interval_tree.hpp>
+#include <monoid.hpp>
 #include <node.hpp>
 #include <tree.hpp>
+#include <treemap.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <random>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
@@ -225,4 +235,975 @@ TEST_CASE("Testing serialization/deserialization", "[Tree::serialize, Tree::dese
     std::stringstream str;
     t2.traverse(Tree<SomeClass>::TraverseType::PreOrder, [&str](SomeClass sc) {str << "(" << sc.a << ")"; });
     REQUIRE(str.str() == "(8)(4)(2)(1)(3)(6)(5)(7)(12)(10)(9)(11)(14)(13)(15)");
-}
\ No newline at end of file
+}
+TEST_CASE("Batched lookups find present keys and report absent ones", "[Tree::find_batch]") {
+    Tree<SomeClass> t;
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+
+    std::vector<SomeClass> keys;
+    for (int i = -5; i < 35; i++) {
+        keys.push_back(SomeClass(i));
+    }
+    std::vector<const SomeClass*> results(keys.size());
+    t.find_batch(keys.data(), keys.size(), results.data());
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i].a >= 1 && keys[i].a <= 15) {
+            REQUIRE(results[i] != nullptr);
+            REQUIRE(results[i]->a == keys[i].a);
+        }
+        else {
+            REQUIRE(results[i] == nullptr);
+        }
+    }
+
+    Tree<SomeClass> empty;
+    empty.find_batch(keys.data(), keys.size(), results.data());
+    REQUIRE(std::all_of(results.begin(), results.end(),
+        [](const SomeClass* p) { return p == nullptr; }));
+}
+
+TEST_CASE("Interleaved lookups agree with batched lookups", "[Tree::find_interleaved]") {
+    Tree<SomeClass> t;
+    // degenerate chain next to a balanced part, so descents differ in depth
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    for (int i = 16; i < 60; i++) {
+        t.insert(SomeClass(i));
+    }
+
+    std::vector<SomeClass> keys;
+    for (int i = 70; i > -10; i--) {
+        keys.push_back(SomeClass(i));
+    }
+    std::vector<const SomeClass*> batched(keys.size());
+    std::vector<const SomeClass*> interleaved(keys.size());
+    t.find_batch(keys.data(), keys.size(), batched.data());
+    t.find_interleaved(keys.data(), keys.size(), interleaved.data());
+    REQUIRE(batched == interleaved);
+    for (size_t i = 0; i < keys.size(); i++) {
+        bool present = keys[i].a >= 1 && keys[i].a < 60;
+        REQUIRE((interleaved[i] != nullptr) == present);
+    }
+
+    Tree<SomeClass> empty;
+    empty.find_interleaved(keys.data(), keys.size(), interleaved.data());
+    REQUIRE(std::all_of(interleaved.begin(), interleaved.end(),
+        [](const SomeClass* p) { return p == nullptr; }));
+}
+
+TEST_CASE("Finger and hinted insertion build the same tree as plain descents", "[Tree::insert]") {
+    Tree<SomeClass> t;
+    std::array<int, 15> numbers = { 16,8,24,4,12,20,28,2,6,10,14,18,22,26,30 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    // ascending run continues from the previous insertion
+    t.insert(SomeClass(31));
+    t.insert(SomeClass(32));
+    // out of the remembered range, falls back to the root
+    t.insert(SomeClass(1));
+    t.insert(SomeClass(11));
+
+    auto hint = t.insert(Tree<SomeClass>::Finger(), SomeClass(17));
+    hint = t.insert(hint, SomeClass(18));
+    REQUIRE(hint.node->getContent().a == 18);
+    REQUIRE(hint.lower->a == 17);
+    REQUIRE(hint.upper->a == 18);
+    hint = t.insert(hint, SomeClass(19));
+    // stale hint whose range doesn't match
+    hint = t.insert(hint, SomeClass(3));
+    REQUIRE(hint.lower->a == 2);
+    REQUIRE(hint.upper->a == 4);
+
+    std::stringstream str;
+    t.traverse(Tree<SomeClass>::TraverseType::PreOrder, [&str](SomeClass sc) {str << "(" << sc.a << ")"; });
+    REQUIRE(str.str() ==
+        "(16)(8)(4)(2)(1)(3)(6)(12)(10)(11)(14)"
+        "(24)(20)(18)(17)(18)(19)(22)(28)(26)(30)(31)(32)");
+
+    // a finger into another tree of the same generation is not followed
+    Tree<int> a;
+    Tree<int> b;
+    auto foreign = a.insert(Tree<int>::Finger(), 5);
+    b.insert(1);
+    b.insert(foreign, 7);
+    REQUIRE(a.size() == 1);
+    REQUIRE(std::distance(a.begin(), a.end()) == 1);
+    REQUIRE(*a.max() == 5);
+    REQUIRE(b.size() == 2);
+    REQUIRE(b.try_find(7) != nullptr);
+
+    // nor is one taken before the tree was move-assigned over
+    Tree<int> c;
+    auto replaced = c.insert(Tree<int>::Finger(), 20);
+    Tree<int> d;
+    d.insert(40);
+    c = std::move(d);
+    c.insert(replaced, 50);
+    REQUIRE(c.size() == 2);
+    REQUIRE(*c.min() == 40);
+    REQUIRE(*c.max() == 50);
+}
+
+TEST_CASE("TreeMap updates values in place", "[TreeMap]") {
+    TreeMap<int, std::string> m;
+    REQUIRE(m.empty());
+    REQUIRE(m.find(1) == nullptr);
+
+    auto r = m.try_emplace(5, "five");
+    REQUIRE(r.second);
+    REQUIRE(*r.first == "five");
+    r = m.try_emplace(5, "FIVE");
+    REQUIRE(!r.second);
+    REQUIRE(*r.first == "five");
+
+    for (int k : { 3, 8, 1, 4, 7, 9 }) {
+        m[k] = std::to_string(k);
+    }
+    REQUIRE(*m.find(4) == "4");
+    const std::string* before = m.find(8);
+
+    r = m.insert_or_assign(8, std::string("eight"));
+    REQUIRE(!r.second);
+    REQUIRE(r.first == before);
+    REQUIRE(*m.find(8) == "eight");
+    r = m.insert_or_assign(2, std::string("two"));
+    REQUIRE(r.second);
+
+    REQUIRE(m.update(3, [](std::string& v) { v += "!"; }));
+    REQUIRE(!m.update(42, [](std::string& v) { v += "!"; }));
+    REQUIRE(*m.find(3) == "3!");
+    REQUIRE(m.contains(2));
+    REQUIRE(!m.contains(6));
+    m[6] += "six";
+    REQUIRE(*m.find(6) == "six");
+
+    std::stringstream str;
+    m.getTree().traverse(Tree<MapEntry<int, std::string>>::TraverseType::InOrder,
+        [&str](MapEntry<int, std::string> e) {str << e.key; });
+    REQUIRE(str.str() == "123456789");
+}
+
+TEST_CASE("Neighbour queries", "[Tree::floor, Tree::ceiling, Tree::predecessor, Tree::successor, Tree::nearest_k]") {
+    Tree<SomeClass> t;
+    REQUIRE(t.floor(SomeClass(1)) == nullptr);
+    REQUIRE(t.nearest_k(SomeClass(1), 3, [](const SomeClass&, const SomeClass&) { return 0; }).empty());
+
+    std::array<int, 15> numbers = { 16,8,24,4,12,20,28,2,6,10,14,18,22,26,30 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    REQUIRE(t.floor(SomeClass(5))->a == 4);
+    REQUIRE(t.floor(SomeClass(4))->a == 4);
+    REQUIRE(t.floor(SomeClass(1)) == nullptr);
+    REQUIRE(t.floor(SomeClass(99))->a == 30);
+    REQUIRE(t.ceiling(SomeClass(5))->a == 6);
+    REQUIRE(t.ceiling(SomeClass(6))->a == 6);
+    REQUIRE(t.ceiling(SomeClass(31)) == nullptr);
+    REQUIRE(t.predecessor(SomeClass(4))->a == 2);
+    REQUIRE(t.predecessor(SomeClass(2)) == nullptr);
+    REQUIRE(t.successor(SomeClass(4))->a == 6);
+    REQUIRE(t.successor(SomeClass(15))->a == 16);
+    REQUIRE(t.successor(SomeClass(30)) == nullptr);
+
+    auto distance = [](const SomeClass& x, const SomeClass& y) { return std::abs(x.a - y.a); };
+    auto nearest = t.nearest_k(SomeClass(13), 5, distance);
+    std::stringstream str;
+    for (auto p : nearest) {
+        str << "(" << p->a << ")";
+    }
+    REQUIRE(str.str() == "(12)(14)(10)(16)(8)");
+    REQUIRE(t.nearest_k(SomeClass(0), 100, distance).size() == 15);
+    REQUIRE(t.nearest_k(SomeClass(40), 2, distance)[1]->a == 28);
+}
+
+TEST_CASE("Cached min/max follow insertions, removals and pops", "[Tree::min, Tree::max, Tree::pop_min, Tree::pop_max]") {
+    Tree<SomeClass> t;
+    REQUIRE(t.min() == nullptr);
+    REQUIRE(t.max() == nullptr);
+    REQUIRE_THROWS(t.pop_min());
+
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    REQUIRE(t.min()->a == 1);
+    REQUIRE(t.max()->a == 15);
+    t.insert(SomeClass(0));
+    t.insert(SomeClass(20));
+    REQUIRE(t.min()->a == 0);
+    REQUIRE(t.max()->a == 20);
+
+    t.remove(SomeClass(0));
+    t.remove(SomeClass(20));
+    REQUIRE(t.min()->a == 1);
+    REQUIRE(t.max()->a == 15);
+    // inner spine nodes
+    t.remove(SomeClass(4));
+    t.remove(SomeClass(12));
+    REQUIRE(t.min()->a == 1);
+    REQUIRE(t.max()->a == 15);
+    // root, which heads both spines
+    t.remove(SomeClass(8));
+    REQUIRE(t.min()->a == 1);
+    REQUIRE(t.max()->a == 15);
+
+    std::stringstream str;
+    while (!t.empty()) {
+        str << "(" << t.pop_min().a << ")";
+        if (!t.empty())
+            str << "[" << t.pop_max().a << "]";
+    }
+    REQUIRE(str.str() == "(1)[15](2)[14](3)[13](5)[11](6)[10](7)[9]");
+    REQUIRE(t.min() == nullptr);
+
+    // degenerate chains from sorted input
+    for (int i = 0; i < 100; i++) {
+        t.insert(SomeClass(i));
+    }
+    for (int i = 0; i < 50; i++) {
+        REQUIRE(t.pop_min().a == i);
+    }
+    for (int i = 99; i >= 50; i--) {
+        REQUIRE(t.max()->a == i);
+        REQUIRE(t.pop_max().a == i);
+    }
+    REQUIRE(t.empty());
+}
+
+// Non-commutative: concatenates the keys, so it also checks the order.
+struct ConcatKeys {
+    using value_type = std::string;
+
+    static value_type identity() {
+        return "";
+    }
+
+    static value_type lift(const SomeClass& sc) {
+        return "(" + std::to_string(sc.a) + ")";
+    }
+
+    static value_type combine(const value_type& a, const value_type& b) {
+        return a + b;
+    }
+};
+
+TEST_CASE("Subtree aggregates answer range reductions", "[Tree::reduce]") {
+    Tree<int, SumMonoid<int>> sums;
+    REQUIRE(sums.reduce() == 0);
+    REQUIRE(sums.reduce(0, 100) == 0);
+    for (int i = 1; i <= 20; i++) {
+        sums.insert(i * 7 % 20 + 1);
+    }
+    REQUIRE(sums.reduce() == 210);
+    REQUIRE(sums.reduce(5, 10) == 45);
+    REQUIRE(sums.reduce(11, 11) == 11);
+    REQUIRE(sums.reduce(-5, 3) == 6);
+    REQUIRE(sums.reduce(21, 30) == 0);
+    sums.remove(7);
+    sums.remove(8); // root
+    REQUIRE(sums.reduce(5, 10) == 30);
+    REQUIRE(sums.pop_min() == 1);
+    REQUIRE(sums.pop_max() == 20);
+    REQUIRE(sums.reduce(1, 20) == sums.reduce());
+
+    Tree<int, MaxMonoid<int>> maxima;
+    for (int n : { 5, 3, 9, 1, 4 }) {
+        maxima.insert(n);
+    }
+    REQUIRE(maxima.reduce(0, 4) == 4);
+    REQUIRE(maxima.reduce(6, 8) == std::numeric_limits<int>::lowest());
+
+    Tree<SomeClass, ConcatKeys> t;
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    REQUIRE(t.reduce(SomeClass(3), SomeClass(11)) == "(3)(4)(5)(6)(7)(8)(9)(10)(11)");
+    REQUIRE(t.reduce(SomeClass(9), SomeClass(10)) == "(9)(10)");
+    t.remove(SomeClass(8));
+    t.remove(SomeClass(12));
+    REQUIRE(t.reduce() == "(1)(2)(3)(4)(5)(6)(7)(9)(10)(11)(13)(14)(15)");
+    REQUIRE(t.reduce(SomeClass(6), SomeClass(13)) == "(6)(7)(9)(10)(11)(13)");
+
+    // a structure built by hand gets its aggregates on first use
+    auto top = Node<int, SumMonoid<int>>::makeNode(5);
+    top->setLeft(Node<int, SumMonoid<int>>::makeNode(3));
+    top->setRight(Node<int, SumMonoid<int>>::makeNode(9));
+    Tree<int, SumMonoid<int>> adopted(std::move(top));
+    REQUIRE(adopted.size() == 3);
+    REQUIRE(*adopted.min() == 3);
+    REQUIRE(adopted.reduce() == 17);
+    REQUIRE(adopted.reduce(4, 9) == 14);
+}
+
+TEST_CASE("Interval tree finds overlapping and stabbed intervals", "[IntervalTree]") {
+    IntervalTree<int> t;
+    REQUIRE(t.stabbing(5).empty());
+
+    std::array<Interval<int>, 8> reservations = {
+        Interval<int>(10, 12), Interval<int>(3, 40), Interval<int>(15, 18),
+        Interval<int>(1, 2), Interval<int>(20, 25), Interval<int>(13, 14),
+        Interval<int>(30, 31), Interval<int>(5, 8) };
+    for (auto& r : reservations) {
+        t.insert(r);
+    }
+    auto show = [](const std::vector<const Interval<int>*>& found) {
+        std::stringstream str;
+        for (auto p : found) {
+            str << "[" << p->low << "," << p->high << "]";
+        }
+        return str.str();
+    };
+    REQUIRE(show(t.stabbing(11)) == "[3,40][10,12]");
+    REQUIRE(show(t.stabbing(2)) == "[1,2]");
+    REQUIRE(show(t.stabbing(41)) == "");
+    REQUIRE(show(t.overlapping(14, 20)) == "[3,40][13,14][15,18][20,25]");
+    REQUIRE(t.overlapping(0, 100).size() == 8);
+
+    t.remove(Interval<int>(3, 40));
+    REQUIRE(show(t.stabbing(11)) == "[10,12]");
+    REQUIRE(show(t.overlapping(26, 29)) == "");
+    REQUIRE(show(t.overlapping(26, 30)) == "[30,31]");
+}
+
+struct CopyCounter {
+    CopyCounter(int _key = 0, const std::string& _payload = "") :
+        key(_key), payload(_payload)
+    { }
+
+    CopyCounter(const CopyCounter& that) :
+        key(that.key), payload(that.payload)
+    {
+        ++copies;
+    }
+
+    CopyCounter(CopyCounter&& that) = default;
+    CopyCounter& operator=(const CopyCounter& that) = default;
+    CopyCounter& operator=(CopyCounter&& that) = default;
+
+    bool operator==(const CopyCounter& that) const {
+        return key == that.key;
+    }
+
+    bool operator<=(const CopyCounter& that) const {
+        return key <= that.key;
+    }
+
+    int key;
+    std::string payload;
+    static int copies;
+};
+
+int CopyCounter::copies = 0;
+
+TEST_CASE("Move insertion and emplacement don't copy the payload", "[Tree::insert, Tree::emplace]") {
+    Tree<CopyCounter> t;
+    CopyCounter::copies = 0;
+    t.insert(CopyCounter(2, "two"));
+    CopyCounter three(3, "three");
+    t.insert(std::move(three));
+    t.emplace(1, "one");
+    auto hint = t.emplace_hint(Tree<CopyCounter>::Finger(), 4, "four");
+    t.insert(hint, CopyCounter(5, "five"));
+    REQUIRE(CopyCounter::copies == 0);
+
+    CopyCounter six(6, "six");
+    t.insert(six);
+    REQUIRE(CopyCounter::copies == 1);
+
+    std::stringstream str;
+    t.traverse(Tree<CopyCounter>::TraverseType::InOrder, [&str](const CopyCounter& c) {str << c.payload << " "; });
+    REQUIRE(str.str() == "one two three four five six ");
+
+    TreeMap<int, CopyCounter> m;
+    CopyCounter::copies = 0;
+    m.try_emplace(1, 1, "one");
+    m.insert_or_assign(2, CopyCounter(2, "two"));
+    m[3].payload = "three";
+    REQUIRE(CopyCounter::copies == 0);
+}
+
+TEST_CASE("Non-throwing lookups and removals", "[Tree::try_find, Tree::try_remove]") {
+    Tree<SomeClass> t;
+    REQUIRE(t.try_find(SomeClass(1)) == nullptr);
+    REQUIRE(!t.try_remove(SomeClass(1)));
+    SomeClass one(1);
+    REQUIRE(noexcept(t.try_remove(one)));
+    REQUIRE(noexcept(t.try_find(one)));
+
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    REQUIRE(t.try_find(SomeClass(7))->a == 7);
+    REQUIRE(t.try_find(SomeClass(16)) == nullptr);
+    REQUIRE(!t.try_remove(SomeClass(16)));
+    REQUIRE_THROWS(t.remove(SomeClass(16)));
+    REQUIRE(t.try_remove(SomeClass(4)));
+    REQUIRE(t.try_find(SomeClass(4)) == nullptr);
+    REQUIRE(!t.try_remove(SomeClass(4)));
+
+    std::stringstream str;
+    t.traverse(Tree<SomeClass>::TraverseType::InOrder, [&str](SomeClass sc) {str << "(" << sc.a << ")"; });
+    REQUIRE(str.str() == "(1)(2)(3)(5)(6)(7)(8)(9)(10)(11)(12)(13)(14)(15)");
+
+    Tree<int> hollow;
+    hollow.setRoot(UPtrNode<int>(new Node<int>()));
+    REQUIRE(hollow.try_find(1) == nullptr);
+    REQUIRE(!hollow.try_remove(1));
+    REQUIRE_THROWS_WITH(hollow.remove(1), "Reading content of empty node");
+}
+
+TEST_CASE("Tree iterators walk in order in both directions", "[Tree::begin, Tree::end, Tree::rbegin, Tree::rend]") {
+    Tree<SomeClass> t;
+    REQUIRE(t.begin() == t.end());
+    REQUIRE(t.rbegin() == t.rend());
+
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    std::stringstream str;
+    for (const auto& sc : t) {
+        if (sc.a > 5)
+            break;
+        str << "(" << sc.a << ")";
+    }
+    REQUIRE(str.str() == "(1)(2)(3)(4)(5)");
+    str.str("");
+    for (auto it = t.rbegin(); it != t.rend(); ++it) {
+        str << "(" << it->a << ")";
+    }
+    REQUIRE(str.str() == "(15)(14)(13)(12)(11)(10)(9)(8)(7)(6)(5)(4)(3)(2)(1)");
+
+    REQUIRE(std::distance(t.begin(), t.end()) == 15);
+    auto it = std::find_if(t.begin(), t.end(), [](const SomeClass& sc) { return sc.a == 9; });
+    REQUIRE(it->a == 9);
+    REQUIRE((--it)->a == 8);
+    REQUIRE((it++)->a == 8);
+    REQUIRE(it->a == 9);
+    auto last = t.end();
+    REQUIRE((--last)->a == 15);
+    REQUIRE(++last == t.end());
+    REQUIRE(std::is_sorted(t.begin(), t.end(),
+        [](const SomeClass& x, const SomeClass& y) { return x.a < y.a; }));
+
+    // chain built from sorted input
+    Tree<SomeClass> chain;
+    for (int i = 0; i < 10; i++) {
+        chain.insert(SomeClass(i));
+    }
+    int expected = 9;
+    for (auto r = chain.rbegin(); r != chain.rend(); ++r) {
+        REQUIRE(r->a == expected--);
+    }
+    REQUIRE(expected == -1);
+}
+
+TEST_CASE("Parent links support erasing by position", "[Tree::erase, Node::getParent]") {
+    Tree<SomeClass> t;
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    auto root = t.peekRoot();
+    REQUIRE(root->getParent() == nullptr);
+    REQUIRE(root->getLeft()->getParent() == root);
+    REQUIRE(root->getRight()->getLeft()->getParent() == root->getRight().get());
+
+    // erase every odd element while iterating
+    for (auto it = t.begin(); it != t.end();) {
+        if (it->a % 2 == 1)
+            it = t.erase(it);
+        else
+            ++it;
+    }
+    std::stringstream str;
+    for (auto& sc : t) {
+        str << "(" << sc.a << ")";
+    }
+    REQUIRE(str.str() == "(2)(4)(6)(8)(10)(12)(14)");
+    REQUIRE(t.min()->a == 2);
+    REQUIRE(t.max()->a == 14);
+    REQUIRE(t.erase(t.begin())->a == 4);
+    REQUIRE(t.erase(--t.end()) == t.end());
+    REQUIRE(t.max()->a == 12);
+
+    // links edited by hand through getRoot() are repaired
+    auto detached = std::move(t.getRoot()->getRight());
+    t.getRoot()->getLeft()->getRight() = std::move(detached);
+    str.str("");
+    t.traverse(Tree<SomeClass>::TraverseType::PostOrder, [&str](SomeClass sc) {str << "(" << sc.a << ")"; });
+    REQUIRE(str.str() == "(10)(12)(4)(8)");
+    REQUIRE(t.max()->a == 8);
+}
+
+TEST_CASE("Traversals of empty and degenerate trees", "[Tree::traverse]") {
+    Tree<SomeClass> t;
+    int visited = 0;
+    auto count = [&visited](SomeClass) { visited++; };
+    t.traverse(Tree<SomeClass>::TraverseType::PreOrder, count);
+    t.traverse(Tree<SomeClass>::TraverseType::InOrder, count);
+    t.traverse(Tree<SomeClass>::TraverseType::PostOrder, count);
+    REQUIRE(visited == 0);
+
+    const int n = 5000;
+    for (int i = 0; i < n; i++) {
+        t.insert(SomeClass(i % 2 == 0 ? i : n * 2 - i));
+    }
+    /*
+            0
+             \
+              9999
+             /
+            2
+             \
+              9997
+                ...
+    */
+    std::vector<int> pre;
+    t.traverse(Tree<SomeClass>::TraverseType::PreOrder, [&pre](SomeClass sc) { pre.push_back(sc.a); });
+    REQUIRE(pre.size() == n);
+    REQUIRE(pre[0] == 0);
+    REQUIRE(pre[1] == 9999);
+    REQUIRE(pre[2] == 2);
+    REQUIRE(pre[n - 1] == n * 2 - (n - 1));
+    std::vector<int> post;
+    t.traverse(Tree<SomeClass>::TraverseType::PostOrder, [&post](SomeClass sc) { post.push_back(sc.a); });
+    REQUIRE(std::equal(pre.begin(), pre.end(), post.rbegin()));
+}
+
+TEST_CASE("Templated traversal passes elements by reference", "[Tree::traverse<Order>]") {
+    Tree<CopyCounter> t;
+    std::array<int, 7> numbers = { 4,2,6,1,3,5,7 };
+    for (auto n : numbers) {
+        t.emplace(n, std::to_string(n));
+    }
+    CopyCounter::copies = 0;
+    std::string pre, in, post;
+    t.traverse<Tree<CopyCounter>::TraverseType::PreOrder>([&pre](const CopyCounter& c) { pre += c.payload; });
+    t.traverse<Tree<CopyCounter>::TraverseType::InOrder>([&in](const CopyCounter& c) { in += c.payload; });
+    t.traverse<Tree<CopyCounter>::TraverseType::PostOrder>([&post](const CopyCounter& c) { post += c.payload; });
+    REQUIRE(CopyCounter::copies == 0);
+    REQUIRE(pre == "4213657");
+    REQUIRE(in == "1234567");
+    REQUIRE(post == "1325764");
+
+    // the std::function overload still copies into its by-value parameter
+    t.traverse(Tree<CopyCounter>::TraverseType::InOrder, [](CopyCounter) {});
+    REQUIRE(CopyCounter::copies == 7);
+}
+
+TEST_CASE("Level-order traversal with a reusable frontier", "[Tree::traverse_levels]") {
+    Tree<SomeClass> t;
+    Tree<SomeClass>::Frontier frontier;
+    std::stringstream str;
+    auto visit = [&str](const SomeClass& sc) { str << "(" << sc.a << ")"; };
+    auto level = [&str](std::size_t depth, std::size_t width) { str << depth << ":" << width << " "; };
+    t.traverse_levels(frontier, visit, level);
+    REQUIRE(str.str() == "");
+
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    t.insert(SomeClass(16));
+    t.traverse_levels(frontier, visit, level);
+    REQUIRE(str.str() ==
+        "0:1 (8)1:2 (4)(12)2:4 (2)(6)(10)(14)3:8 (1)(3)(5)(7)(9)(11)(13)(15)4:1 (16)");
+
+    // same frontier again
+    str.str("");
+    t.traverse_levels(frontier, visit);
+    REQUIRE(str.str() == "(8)(4)(12)(2)(6)(10)(14)(1)(3)(5)(7)(9)(11)(13)(15)(16)");
+
+    str.str("");
+    t.traverse(Tree<SomeClass>::TraverseType::LevelOrder, [&str](SomeClass sc) {str << sc.a << " "; });
+    REQUIRE(str.str() == "8 4 12 2 6 10 14 1 3 5 7 9 11 13 15 16 ");
+}
+
+TEST_CASE("Pruned traversal stops early and skips subtrees", "[Tree::traverse_pruned]") {
+    using SCTree = Tree<SomeClass>;
+    SCTree t;
+    std::array<int, 15> numbers = { 8,4,12,2,6,10,14,1,3,5,7,9,11,13,15 };
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    std::stringstream str;
+    // first element violating a predicate
+    auto finished = t.traverse_pruned<SCTree::TraverseType::InOrder>([&str](const SomeClass& sc) {
+        str << "(" << sc.a << ")";
+        return sc.a * sc.a > 30 ? SCTree::Control::Stop : SCTree::Control::Continue;
+    });
+    REQUIRE(!finished);
+    REQUIRE(str.str() == "(1)(2)(3)(4)(5)(6)");
+
+    str.str("");
+    finished = t.traverse_pruned<SCTree::TraverseType::PreOrder>([&str](const SomeClass& sc) {
+        str << "(" << sc.a << ")";
+        return sc.a == 4 || sc.a == 14 ? SCTree::Control::SkipSubtree : SCTree::Control::Continue;
+    });
+    REQUIRE(finished);
+    REQUIRE(str.str() == "(8)(4)(12)(10)(9)(11)(14)");
+
+    str.str("");
+    t.traverse_pruned<SCTree::TraverseType::InOrder>([&str](const SomeClass& sc) {
+        str << "(" << sc.a << ")";
+        return sc.a == 4 ? SCTree::Control::SkipSubtree : SCTree::Control::Continue;
+    });
+    REQUIRE(str.str() == "(1)(2)(3)(4)(8)(9)(10)(11)(12)(13)(14)(15)");
+
+    str.str("");
+    finished = t.traverse_pruned<SCTree::TraverseType::PostOrder>([&str](const SomeClass& sc) {
+        str << "(" << sc.a << ")";
+        return sc.a == 6 ? SCTree::Control::SkipSubtree :
+            sc.a == 9 ? SCTree::Control::Stop : SCTree::Control::Continue;
+    });
+    REQUIRE(!finished);
+    REQUIRE(str.str() == "(1)(3)(2)(5)(7)(6)(4)(9)");
+}
+
+TEST_CASE("Pull-based walks can be advanced side by side", "[Tree::in_order, Tree::pre_order, Tree::post_order]") {
+    Tree<int> odd;
+    Tree<int> even;
+    for (auto n : { 5, 3, 7, 1, 9 }) {
+        odd.insert(n);
+    }
+    for (auto n : { 6, 2, 8, 4, 10 }) {
+        even.insert(n);
+    }
+    std::vector<int> merged;
+    auto left = odd.in_order();
+    auto right = even.in_order();
+    std::merge(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(merged));
+    REQUIRE(merged == std::vector<int>({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 }));
+
+    auto pre = odd.pre_order();
+    REQUIRE(std::vector<int>(pre.begin(), pre.end()) == std::vector<int>({ 5, 3, 1, 7, 9 }));
+    auto post = odd.post_order();
+    REQUIRE(std::vector<int>(post.begin(), post.end()) == std::vector<int>({ 1, 3, 9, 7, 5 }));
+
+    // a walk can be left at any point
+    auto it = even.pre_order().begin();
+    REQUIRE(*it++ == 6);
+    REQUIRE(*it == 2);
+
+    Tree<int> none;
+    REQUIRE(none.in_order().begin() == none.in_order().end());
+}
+
+TEST_CASE("Parallel reduction keeps the in-order sequence", "[Tree::parallel_reduce, Tree::parallel_for_each]") {
+    Tree<int> t;
+    std::vector<int> numbers(1000);
+    for (std::size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = static_cast<int>(i);
+    }
+    std::shuffle(numbers.begin(), numbers.end(), std::mt19937(7));
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    auto square = [](int n) { return static_cast<long long>(n) * n; };
+    auto add = [](long long a, long long b) { return a + b; };
+    REQUIRE(t.parallel_reduce(0LL, square, add, 8) == 332833500LL);
+    REQUIRE(t.parallel_reduce(0LL, square, add, 1) == 332833500LL);
+
+    // concatenation isn't commutative
+    auto digits = [](int n) { return std::to_string(n % 10); };
+    auto concat = [](std::string a, const std::string& b) { return a += b; };
+    std::string expected;
+    for (int n = 0; n < 1000; ++n) {
+        expected += std::to_string(n % 10);
+    }
+    REQUIRE(t.parallel_reduce(std::string(), digits, concat, 8) == expected);
+
+    std::atomic<long long> sum(0);
+    t.parallel_for_each([&sum](int n) { sum += n; }, 8);
+    REQUIRE(sum == 499500);
+
+    REQUIRE_THROWS(t.parallel_for_each([](int n) {
+        if (n == 500)
+            throw std::runtime_error("visitor failed");
+    }, 4));
+
+    Tree<int> none;
+    REQUIRE(none.parallel_reduce(0LL, square, add, 8) == 0);
+}
+
+TEST_CASE("Chunked traversal hands over full chunks", "[Tree::traverse_chunked]") {
+    using IntTree = Tree<int>;
+    IntTree t;
+    std::vector<std::size_t> sizes;
+    t.traverse_chunked<IntTree::TraverseType::InOrder, 4>([&sizes](const int* const*, std::size_t count) {
+        sizes.push_back(count);
+    });
+    REQUIRE(sizes.empty());
+
+    for (auto n : { 5, 3, 8, 1, 4, 7, 9, 2, 6, 10 }) {
+        t.insert(n);
+    }
+    std::vector<int> seen;
+    t.traverse_chunked<IntTree::TraverseType::InOrder, 4>([&](const int* const* elements, std::size_t count) {
+        sizes.push_back(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            seen.push_back(*elements[i]);
+        }
+    });
+    REQUIRE(sizes == std::vector<std::size_t>({ 4, 4, 2 }));
+    REQUIRE(seen == std::vector<int>({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 }));
+
+    seen.clear();
+    t.traverse_chunked<IntTree::TraverseType::PreOrder>([&seen](const int* const* elements, std::size_t count) {
+        REQUIRE(count == 10);
+        for (std::size_t i = 0; i < count; ++i) {
+            seen.push_back(*elements[i]);
+        }
+    });
+    REQUIRE(seen == std::vector<int>({ 5, 3, 1, 2, 4, 8, 7, 6, 9, 10 }));
+}
+
+TEST_CASE("Prefetching traversal visits in order", "[Tree::traverse_prefetched]") {
+    Tree<int> t;
+    std::vector<int> seen;
+    t.traverse_prefetched([&seen](const int& n) { seen.push_back(n); });
+    REQUIRE(seen.empty());
+
+    std::vector<int> numbers(200);
+    for (std::size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = static_cast<int>(i / 2);
+    }
+    std::shuffle(numbers.begin(), numbers.end(), std::mt19937(11));
+    for (auto n : numbers) {
+        t.insert(n);
+    }
+    t.traverse_prefetched([&seen](const int& n) { seen.push_back(n); });
+    std::sort(numbers.begin(), numbers.end());
+    REQUIRE(seen == numbers);
+}
+
+TEST_CASE("Sorted and columnar export", "[Tree::size, Tree::export_sorted, Tree::export_columns]") {
+    Tree<SomeClass> t;
+    REQUIRE(t.size() == 0);
+    for (auto n : { 4, 2, 6, 1, 3, 5, 7, 3 }) {
+        t.insert(SomeClass(n));
+    }
+    REQUIRE(t.size() == 8);
+    t.remove(SomeClass(3));
+    t.pop_max();
+    REQUIRE(t.size() == 6);
+    t.getRoot()->getLeft().reset();
+    REQUIRE(t.size() == 3);
+    t.insert(SomeClass(2));
+    REQUIRE(t.size() == 4);
+
+    std::vector<SomeClass> sorted;
+    sorted.reserve(t.size());
+    t.export_sorted(std::back_inserter(sorted));
+    REQUIRE(sorted.size() == 4);
+    REQUIRE(sorted[0].a == 2);
+    REQUIRE(sorted[3].a == 6);
+
+    std::vector<int> keys = { -1 };
+    std::vector<double> halves;
+    t.export_columns(keys, halves,
+        [](const SomeClass& sc) { return sc.a; },
+        [](const SomeClass& sc) { return sc.a / 2.0; });
+    REQUIRE(keys == std::vector<int>({ -1, 2, 4, 5, 6 }));
+    REQUIRE(halves == std::vector<double>({ 1.0, 2.0, 2.5, 3.0 }));
+
+    int raw[4];
+    REQUIRE(Tree<int>().export_sorted(raw) == raw);
+}
+
+template<class NodeT>
+std::size_t heightOf(NodeT* node) {
+    return node == nullptr ? 0 :
+        1 + std::max(heightOf(node->getLeft().get()), heightOf(node->getRight().get()));
+}
+
+TEST_CASE("Bulk build from a sorted range is balanced", "[Tree::build_sorted]") {
+    Tree<int> t;
+    t.insert(42);
+    std::vector<int> numbers(1023);
+    for (std::size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = static_cast<int>(i);
+    }
+    t.build_sorted(numbers.begin(), numbers.end());
+    REQUIRE(t.size() == 1023);
+    REQUIRE(heightOf(t.peekRoot()) == 10);
+    REQUIRE(*t.min() == 0);
+    REQUIRE(*t.max() == 1022);
+    REQUIRE(std::vector<int>(t.begin(), t.end()) == numbers);
+    t.insert(1023);
+    t.remove(511);
+    REQUIRE(t.size() == 1023);
+    REQUIRE(t.try_find(42) != nullptr);
+    REQUIRE(t.try_find(511) == nullptr);
+
+    // elements equal for ordering must all be found by a descent
+    Tree<SomeClass> equal;
+    std::vector<SomeClass> runs = { SomeClass(1), SomeClass(2, 1), SomeClass(2, 2),
+        SomeClass(2, 3), SomeClass(2, 4), SomeClass(3), SomeClass(4) };
+    equal.build_sorted(runs.begin(), runs.end());
+    for (auto& sc : runs) {
+        REQUIRE(equal.try_find(sc) != nullptr);
+    }
+    REQUIRE(equal.ceiling(SomeClass(2))->a == 2);
+    REQUIRE(equal.successor(SomeClass(2))->a == 3);
+
+    IntervalTree<int> intervals;
+    std::vector<Interval<int>> sorted = { Interval<int>(1, 2), Interval<int>(3, 40),
+        Interval<int>(5, 8), Interval<int>(10, 12), Interval<int>(13, 14) };
+    intervals.build_sorted(sorted.begin(), sorted.end());
+    REQUIRE(intervals.stabbing(11).size() == 2);
+
+    t.build_sorted(numbers.end(), numbers.end());
+    REQUIRE(t.empty());
+    REQUIRE(t.min() == nullptr);
+}
+
+TEST_CASE("Batched insertion merges and rebalances", "[Tree::insert_batch]") {
+    Tree<int> t;
+    std::vector<int> batch = { 9, 3, 7, 1, 5 };
+    t.insert_batch(batch.begin(), batch.end());
+    REQUIRE(std::vector<int>(t.begin(), t.end()) == std::vector<int>({ 1, 3, 5, 7, 9 }));
+
+    // a degenerate chain comes out balanced
+    Tree<int> chain;
+    for (int n = 0; n < 100; ++n) {
+        chain.insert(n);
+    }
+    REQUIRE(heightOf(chain.peekRoot()) == 100);
+    std::vector<int> more;
+    for (int n = 100; n < 127; ++n) {
+        more.push_back(n);
+    }
+    std::shuffle(more.begin(), more.end(), std::mt19937(5));
+    chain.insert_batch(more.begin(), more.end());
+    REQUIRE(chain.size() == 127);
+    REQUIRE(heightOf(chain.peekRoot()) == 7);
+    REQUIRE(*chain.max() == 126);
+
+    std::vector<int> odd = { 8, 2, 4, 6, 4 };
+    t.insert_batch(odd.begin(), odd.end());
+    REQUIRE(std::vector<int>(t.begin(), t.end()) == std::vector<int>({ 1, 2, 3, 4, 4, 5, 6, 7, 8, 9 }));
+    REQUIRE(t.size() == 10);
+    t.remove(4);
+    t.remove(4);
+    REQUIRE(t.try_find(4) == nullptr);
+
+    Tree<int, SumMonoid<int>> sums;
+    sums.insert(100);
+    sums.insert_batch(batch.begin(), batch.end());
+    REQUIRE(sums.reduce() == 125);
+    REQUIRE(sums.reduce(3, 7) == 15);
+
+    // a hint taken before the rebuild no longer describes its node
+    Tree<int> hinted;
+    auto hint = hinted.insert(Tree<int>::Finger(), 1);
+    for (int n = 2; n <= 7; ++n) {
+        hinted.insert(n);
+    }
+    std::vector<int> tail = { 8, 9 };
+    hinted.insert_batch(tail.begin(), tail.end());
+    hinted.insert(hint, 100);
+    REQUIRE(std::vector<int>(hinted.begin(), hinted.end()) ==
+        std::vector<int>({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 100 }));
+    REQUIRE(hinted.try_find(100) != nullptr);
+    REQUIRE(*hinted.max() == 100);
+}
+
+TEST_CASE("Merging trees reuses their elements", "[Tree::merge]") {
+    Tree<CopyCounter> left;
+    Tree<CopyCounter> right;
+    for (auto n : { 4, 2, 6 }) {
+        left.emplace(n, std::to_string(n));
+    }
+    for (auto n : { 1, 3, 5, 7 }) {
+        right.emplace(n, std::to_string(n));
+    }
+    auto three = &*std::next(right.begin());
+    auto hint = left.emplace_hint(Tree<CopyCounter>::Finger(), 8, "8");
+    CopyCounter::copies = 0;
+    left.merge(std::move(right));
+    REQUIRE(CopyCounter::copies == 0);
+    REQUIRE(right.empty());
+    REQUIRE(right.size() == 0);
+    REQUIRE(right.min() == nullptr);
+    REQUIRE(left.size() == 8);
+    REQUIRE(heightOf(left.peekRoot()) == 4);
+    std::string in;
+    left.traverse<Tree<CopyCounter>::TraverseType::InOrder>([&in](const CopyCounter& c) { in += c.payload; });
+    REQUIRE(in == "12345678");
+    REQUIRE(&*std::next(left.begin(), 2) == three);
+
+    // the hint is stale after the merge
+    left.emplace_hint(hint, 9, "9");
+    REQUIRE(std::prev(left.end())->payload == "9");
+    REQUIRE(left.try_find(CopyCounter(9)) != nullptr);
+
+    left.merge(std::move(left));
+    REQUIRE(left.size() == 9);
+    right.emplace(0, "0");
+    REQUIRE(right.begin()->payload == "0");
+    left.merge(std::move(right));
+    REQUIRE(left.min()->payload == "0");
+}
+
+TEST_CASE("Splitting and joining relink nodes", "[Tree::split, Tree::join]") {
+    using SumTree = Tree<int, SumMonoid<int>>;
+    SumTree t;
+    std::vector<int> numbers(15);
+    for (std::size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = static_cast<int>(i + 1);
+    }
+    t.build_sorted(numbers.begin(), numbers.end());
+    auto eleven = &*std::next(t.begin(), 10);
+
+    auto greater = t.split(7);
+    REQUIRE(std::vector<int>(t.begin(), t.end()) == std::vector<int>({ 1, 2, 3, 4, 5, 6, 7 }));
+    REQUIRE(std::vector<int>(greater.begin(), greater.end()) ==
+        std::vector<int>({ 8, 9, 10, 11, 12, 13, 14, 15 }));
+    REQUIRE(t.size() == 7);
+    REQUIRE(greater.size() == 8);
+    REQUIRE(*t.max() == 7);
+    REQUIRE(*greater.min() == 8);
+    REQUIRE(t.reduce() == 28);
+    REQUIRE(greater.reduce() == 92);
+    REQUIRE(greater.reduce(9, 11) == 30);
+    REQUIRE(&*std::next(greater.begin(), 3) == eleven);
+
+    auto none = greater.split(20);
+    REQUIRE(none.empty());
+    REQUIRE(none.max() == nullptr);
+    REQUIRE(greater.size() == 8);
+
+    REQUIRE_THROWS(SumTree::join(std::move(greater), std::move(t)));
+    REQUIRE(greater.size() == 8);
+    REQUIRE(t.size() == 7);
+
+    auto joined = SumTree::join(std::move(t), std::move(greater));
+    REQUIRE(t.empty());
+    REQUIRE(greater.empty());
+    REQUIRE(greater.size() == 0);
+    REQUIRE(std::vector<int>(joined.begin(), joined.end()) == numbers);
+    REQUIRE(joined.size() == 15);
+    REQUIRE(joined.reduce() == 120);
+    REQUIRE(joined.reduce(6, 9) == 30);
+    REQUIRE(*joined.min() == 1);
+    REQUIRE(*joined.max() == 15);
+    joined.insert(16);
+    joined.remove(7);
+    REQUIRE(joined.reduce() == 129);
+
+    auto all = SumTree::join(std::move(joined), SumTree());
+    REQUIRE(all.size() == 15);
+    REQUIRE(joined.empty());
+    all = SumTree::join(SumTree(), std::move(all));
+    REQUIRE(all.size() == 15);
+}